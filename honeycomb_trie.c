@@ -1,7 +1,26 @@
+/* getline, fsync and madvise are POSIX, not ISO C. */
+#define _DEFAULT_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <limits.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* Build with -DHAVE_ZLIB -lz and/or -DHAVE_ZSTD -lzstd to read
+   compressed dictionaries. */
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
 
 #define ALPHABET_SIZE (26)
 
@@ -13,222 +32,3166 @@
 
 /*
  * Trie node.
+ *
+ * Children are 32 bit indices into the owning trie's node
+ * vector rather than pointers, which halves the node size and
+ * keeps the trie valid when the vector is moved. The root is
+ * always node 0 and is never a child, so 0 marks a missing child.
  */
 typedef struct trie_node
 {
-    struct trie_node *next[ALPHABET_SIZE];
+    uint32_t next[ALPHABET_SIZE];
 
-    // is_end is true if the node represents end of a word
-    bool is_end;
+    // word is the id of the word the node ends, or NO_WORD
+    uint32_t word;
 } trie_node;
 
+/* Index of the root node; doubles as the "no child" marker. */
+#define TRIE_ROOT 0
+#define NO_NODE 0
+
+/* Word id of a node that does not end a word. */
+#define NO_WORD UINT32_MAX
+
+/* Number of nodes the node vector starts with. */
+#define TRIE_INITIAL_CAPACITY 4096
+
+/*
+ * Trie owning all of its nodes in one contiguous vector.
+ */
+typedef struct trie {
+    trie_node *nodes;
+    uint32_t size;
+    uint32_t capacity;
+
+    // In a DAWG an end node is shared by many words, so its word is
+    // 0 rather than an id; counts[i] is the number of words that
+    // continue from node i, which gives ids by counting instead.
+    uint32_t *counts;
+} trie;
+
+/*
+ * List of the words read from a dictionary file. The words are
+ * NUL terminated strings packed one after another in 'pool'.
+ * Once the dictionary is built, a word's index in 'words' is
+ * its word id.
+ */
+typedef struct word_list {
+    char *pool;
+    char **words;
+    uint32_t count;
+
+    // Lists mapped from a dictionary image have no 'words'; word i
+    // is at pool + offsets[i] instead, within the pool_size bytes
+    // of the pool.
+    uint32_t *offsets;
+    uint64_t pool_size;
+} word_list;
+
+/* Bytes read_words reads at a time, and the decompressor's buffers. */
+#define READ_CHUNK (1 << 20)
+#define INPUT_CHUNK (1 << 16)
+
+/* Formats of dictionary files, told apart by their first bytes. */
+enum input_format {
+    INPUT_PLAIN,
+    INPUT_GZIP,
+    INPUT_ZSTD
+};
+
+#define INPUT_MAGIC_SIZE 4
+
+/*
+ * Decompression of a dictionary file on a thread of its own. The
+ * thread reads 'in', starting with the 'prefix' bytes already taken
+ * from it to find the format, and writes the text to the pipe
+ * 'out', which read_words splits into words while the thread
+ * decompresses the next chunk.
+ */
+typedef struct input_job {
+    FILE *in;
+    int out;
+    int format;
+    unsigned char prefix[INPUT_MAGIC_SIZE];
+    size_t prefix_size;
+    pthread_t thread;
+    bool running;
+} input_job;
+
+/*
+ * State for building a minimal DAWG from sorted words.
+ *
+ * Nodes on the path of the previously inserted word are still
+ * open; all other nodes are in the register, a hash set keyed on
+ * node contents used to find an existing equivalent node.
+ */
+typedef struct dawg_builder {
+    trie *t;
+    uint32_t *table;
+    uint32_t table_size;
+    uint32_t count;
+
+    // chain of discarded nodes, linked through next[0]
+    uint32_t free_list;
+
+    // path[i] is the node reached by the first i letters of prev
+    uint32_t path[WORD_SIZE];
+    char prev[WORD_SIZE];
+    int prev_len;
+} dawg_builder;
+
+/*
+ * Work shared by the threads of fill_trie_parallel. The words
+ * starting with letter c are words[start[c]] up to words[start[c + 1]]
+ * of 'list' and go into their own trie, subs[c]; threads take the
+ * letters one at a time through next_letter.
+ */
+typedef struct fill_work {
+    word_list *list;
+    uint32_t start[ALPHABET_SIZE + 1];
+    trie *subs[ALPHABET_SIZE];
+
+    // words of letter c left after dropping repeats, and whether
+    // they were sorted
+    uint32_t kept[ALPHABET_SIZE];
+    bool sorted[ALPHABET_SIZE];
+    int next_letter;
+} fill_work;
+
+/* Word lists shorter than this are not worth building in parallel. */
+#define PARALLEL_MIN_WORDS 65536
+
+/*
+ * Sparse trie node.
+ *
+ * Only the children that exist are stored, packed next to each
+ * other starting at 'first'. Bit i of 'mask' is set when the child
+ * for letter i exists, so the child for letter i lives at
+ * first + popcount(mask bits below i).
+ */
+typedef struct sparse_node {
+    uint32_t mask;
+    uint32_t first;
+
+    // word is the id of the word the node ends, or NO_WORD
+    uint32_t word;
+} sparse_node;
+
+/*
+ * Sparse trie: nodes in breadth first order, with the children
+ * of every node adjacent. The root is node 0.
+ */
+typedef struct sparse_trie {
+    sparse_node *nodes;
+    uint32_t size;
+} sparse_trie;
+
+/*
+ * Double-array trie.
+ *
+ * State s has the child for letter i at slot t = base[s] + i when
+ * check[t] == s, so a transition is two array reads. The root is
+ * state 0. The arrays are padded by ALPHABET_SIZE slots so
+ * base[s] + i never needs a bounds check.
+ */
+typedef struct double_array {
+    uint32_t *base;
+    uint32_t *check;
+
+    // word[s] is the word id of an end state; only read on a match
+    uint32_t *word;
+    uint32_t size;
+} double_array;
+
+/* Bit of double_array::base set when the state ends a word. */
+#define DA_END (1u << 31)
+
+/* check[] value of a slot no state occupies. */
+#define DA_FREE UINT32_MAX
+
+/*
+ * LOUDS succinct trie.
+ *
+ * Nodes are numbered breadth first with the root as node 0. 'bits'
+ * holds, for each node in order, one 1 bit per child followed by a
+ * 0 bit, so node i's children are the nodes numbered from the count
+ * of 1 bits before node i's run, plus one. labels[j - 1] is the
+ * letter on the edge into node j. Besides the letters this costs
+ * about three bits per node.
+ *
+ * Word ids follow the order of the end nodes, so the id of the
+ * word ending at node i is the number of end nodes before it;
+ * end_rank[w] counts the end nodes before word w of is_end.
+ */
+typedef struct louds_trie {
+    uint64_t *bits;
+    uint64_t *is_end;
+    uint32_t *end_rank;
+
+    // select_hint[k] is the position of 0 bit number k * LOUDS_SELECT_STEP
+    uint32_t *select_hint;
+    uint8_t *labels;
+    uint32_t size;
+} louds_trie;
+
+/* Number of 0 bits between select hints. */
+#define LOUDS_SELECT_STEP 256
+
+/*
+ * Radix trie node.
+ *
+ * Chains of nodes that neither end a word nor branch are collapsed
+ * into the edge above them, so an edge is labelled with a run of
+ * letters. The first letter selects the child from the parent's
+ * 'mask' the same way as in sparse_node; the rest of the run,
+ * label_len letter indices, is stored at labels[label]. Nodes are
+ * in breadth first order with the root as node 0.
+ */
+typedef struct radix_node {
+    uint32_t mask;
+    uint32_t first;
+    uint32_t label;
+    uint32_t label_len;
+
+    // word is the id of the word the node ends, or NO_WORD
+    uint32_t word;
+} radix_node;
+
+/*
+ * Radix trie: the nodes and the pool of edge label letters.
+ */
+typedef struct radix_trie {
+    radix_node *nodes;
+    uint8_t *labels;
+    uint32_t size;
+    uint32_t labels_size;
+} radix_trie;
+
+/*
+ * Summary of the words continuing below a node, used to prune the
+ * search. Only continuations of at least one letter count, not a
+ * word ending at the node itself. 'need' has bit i set if every
+ * continuation contains letter i, 'has' if any does; min_len and
+ * max_len are the shortest and longest continuation. max_len is 0
+ * if there are none.
+ */
+typedef struct node_summary {
+    uint32_t need;
+    uint32_t has;
+    uint16_t min_len;
+    uint16_t max_len;
+} node_summary;
+
+/* Mask with one bit for every letter. */
+#define ALL_LETTERS ((1u << ALPHABET_SIZE) - 1)
+
+/*
+ * Trie representations the word search can walk.
+ */
+typedef enum trie_kind {
+    TRIE_ARRAY,
+    TRIE_DAWG,
+    TRIE_SPARSE,
+    TRIE_DOUBLE_ARRAY,
+    TRIE_LOUDS,
+    TRIE_RADIX
+} trie_kind;
+
+/*
+ * Dictionary searched by find_words. Holds the trie in the
+ * representation chosen by 'kind'; nodes are identified by 32 bit
+ * indices whatever the representation, with TRIE_ROOT as the root.
+ * Searches report word ids; 'words' turns them back into words.
+ */
+typedef struct dict {
+    trie_kind kind;
+    word_list *words;
+
+    // ordered is true if word ids follow the words' sort order
+    bool ordered;
+
+    trie *trie;
+    sparse_trie *sparse;
+    double_array *da;
+    louds_trie *louds;
+    radix_trie *radix;
+
+    // summary[i] summarizes node i's continuations, if not NULL
+    node_summary *summary;
+
+    // mapped dictionary image the arrays above point into, if any
+    void *image;
+    size_t image_size;
+} dict;
+
+/*
+ * Dictionary image.
+ *
+ * A dict written out by write_dict so that map_dict can map it
+ * back read only and search it without building anything. Every
+ * array of the dict is a section of the file, found through the
+ * section table in the header. Nodes refer to each other by index,
+ * so the arrays are used where they are mapped. The image is in
+ * the byte order of the machine that wrote it.
+ *
+ * The header checksum covers the header and its section table, so
+ * opening an image reads one page whatever its size; the sections
+ * are paged in as searches reach them. Every section has a checksum
+ * of its own too, but as checking those reads the whole image they
+ * are only checked when asked for (-v). Either way, every node and
+ * word index read from an image is checked against the counts in
+ * the header before it is used, so a damaged image is reported
+ * rather than read out of bounds.
+ */
+#define IMAGE_MAGIC "HCDICT\0\0"
+#define IMAGE_MAGIC_SIZE 8
+
+/* Changes whenever the layout of the image changes. */
+#define IMAGE_VERSION 2
+
+/* Letters in CHAR_TO_INDEX order; images only work with the same. */
+#define IMAGE_ALPHABET "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+#define IMAGE_ALPHABET_SIZE 32
+
+/* Sections start at multiples of this many bytes. */
+#define IMAGE_ALIGN 64
+
+enum image_sections {
+    SECTION_POOL,
+    SECTION_OFFSETS,
+    SECTION_NODES,
+    SECTION_COUNTS,
+    SECTION_BASE,
+    SECTION_CHECK,
+    SECTION_WORD,
+    SECTION_BITS,
+    SECTION_IS_END,
+    SECTION_END_RANK,
+    SECTION_SELECT_HINT,
+    SECTION_LABELS,
+    SECTION_SUMMARY,
+    IMAGE_SECTIONS
+};
+
+typedef struct image_section {
+    uint64_t offset;
+    uint64_t size;
+
+    // FNV-1a hash of the section's bytes
+    uint64_t checksum;
+} image_section;
+
+typedef struct image_header {
+    char magic[IMAGE_MAGIC_SIZE];
+    uint32_t version;
+    uint32_t header_size;
+    char alphabet[IMAGE_ALPHABET_SIZE];
+    uint64_t file_size;
+    uint32_t kind;
+    uint32_t ordered;
+    uint32_t word_count;
+
+    // number of nodes, or of double array slots
+    uint32_t node_count;
+    image_section sections[IMAGE_SECTIONS];
+
+    // FNV-1a hash of the header with checksum set to 0
+    uint64_t checksum;
+} image_header;
+
+/*
+ * State for writing a dictionary image.
+ */
+typedef struct image_writer {
+    FILE *fp;
+    uint64_t offset;
+
+    // failed is set once a write fails; later puts are skipped
+    bool failed;
+
+    // hash of what was put since the current section began
+    uint64_t hash;
+    image_header header;
+} image_writer;
+
 /*
  *  Datastructure to store Honeycomb.
+ *
+ * Cells are placed by axial coordinates (q, r): q numbers the
+ * columns from -radius to radius, left to right, and r the cells
+ * down a column, with q + r constant along the other diagonal.
+ * A cell is in the honeycomb when |q|, |r| and |q + r| are all at
+ * most radius.
+ *
+ * The letters are in 'cells', one column after another, each from
+ * its smallest r, so cell (q, r) is cells[column_base[q + radius] + r].
+ * Neighbors are found from the coordinates as the search goes;
+ * directions[cell] has bit i set if the step hex_directions[i]
+ * stays in the honeycomb, so the search needs no bounds checks and
+ * a cell costs only that byte besides its letter.
  */
 typedef struct honeycomb {
-    int number_columns;
-    char **columns;
+    int radius;
+    int size;
+    char *cells;
+    uint8_t *directions;
+    int *column_base;
 } honeycomb;
 
+/* Most cells a honeycomb cell is adjacent to. */
+#define HEX_NEIGHBORS 6
+
+/* Most layers a honeycomb can have; its 3 * layers * (layers - 1) + 1
+   cells can then be numbered with an int. */
+#define MAX_LAYERS 26000
+
+/* Axial (q, r) steps to the six neighbors of a cell, clockwise
+   from the one above it. */
+static const int hex_directions[HEX_NEIGHBORS][2] = {
+    { 0, -1 }, { 1, -1 }, { 1, 0 }, { 0, 1 }, { -1, 1 }, { -1, 0 }
+};
+
+/*
+ * Datastructure to track which words a search already reported,
+ * kept apart from the dictionary so searching never modifies it.
+ * The word with id i was reported by the current search if
+ * seen[i] equals generation; starting a new search just bumps
+ * generation instead of clearing seen.
+ */
+typedef struct match_set {
+    uint32_t *seen;
+    uint32_t size;
+    uint32_t generation;
+} match_set;
+
 /*
  * Datastructure to store words found in honeycomb.
  */
 typedef struct word_store {
     int size;
-    char **words;
+    int capacity;
+
+    // ids of the words found
+    uint32_t *words;
 } word_store;
 
+/*
+ * State of one search of a honeycomb.
+ */
+typedef struct search {
+    const honeycomb *hc;
+    const dict *d;
+    match_set *matches;
+    word_store *store;
+
+    // letters has bit i set if letter i is in the honeycomb
+    uint32_t letters;
+    int cells;
+
+    // bit i of the set is on if cell i is on the current path; the
+    // honeycomb itself is never written, so searches can share it
+    uint64_t *path;
+} search;
+
+/* Largest honeycomb whose path fits in one uint64_t. */
+#define SMALL_HONEYCOMB 64
+
 /*
  * get_trienode
  *
- * Returns a new trie node and initialize all next pointers to NULL
+ * Returns the index of a new trie node with all next indices set
+ * to NO_NODE. The node vector doubles when full, so node
+ * allocation is amortized O(1) and never a malloc per node.
+ *
+ * Pointers into t->nodes are invalidated by this call.
  */
-trie_node *
-get_trienode(void)
+uint32_t
+get_trienode(trie *t)
 {
-    trie_node *node = NULL;
+    if (t->size == t->capacity) {
+        uint32_t capacity = t->capacity ? 2 * t->capacity
+                                        : TRIE_INITIAL_CAPACITY;
+        trie_node *nodes = (trie_node *) realloc(t->nodes,
+                                                 capacity * sizeof(trie_node));
+        if (nodes == NULL) {
+            printf("Error: Failed to allocate memory for Trie Node.\n");
+            exit(1);
+        }
 
-    node = (trie_node *)malloc(sizeof(trie_node));
-    if (node == NULL) {
-        printf("Error: Failed to allocate memory for Trie Node.\n");
-        exit(1);
+        t->nodes = nodes;
+        t->capacity = capacity;
     }
 
-    node->is_end = false;
+    trie_node *node = &t->nodes[t->size];
+    memset(node->next, 0, sizeof(node->next));
+    node->word = NO_WORD;
 
-    int i;
-    for (i = 0; i < ALPHABET_SIZE; i++) {
-       node->next[i] = NULL;
+    return t->size++;
+}
+
+/*
+ * create_trie
+ *
+ * Create an empty trie holding only the root node.
+ */
+trie *
+create_trie(void)
+{
+    trie *t = (trie *) malloc(sizeof(trie));
+    if (t == NULL) {
+        printf("Error: Failed to allocate memory for Trie.\n");
+        exit(1);
     }
 
-    return node;
+    t->nodes = NULL;
+    t->size = 0;
+    t->capacity = 0;
+    t->counts = NULL;
+    get_trienode(t);
+
+    return t;
 }
 
 /*
  * insert_trie
  *
- * Insert a string(key) if not present, into the trie.
- * If the key is prefix of trie node, just marks leaf node.
+ * Insert a string(key) with word id 'word' if not present, into
+ * the trie. If the key is prefix of trie node, just marks leaf node.
+ * Returns the id the key ends up with, which is the id it was first
+ * inserted with if it was already present.
  */
-void
-insert_trie(trie_node *root, const char *key)
+uint32_t
+insert_trie(trie *t, const char *key, uint32_t word)
 {
     int level;
     int length = strlen(key);
     int index;
 
-    trie_node *parent = root;
+    uint32_t parent = TRIE_ROOT;
 
     for (level = 0; level < length; level++) {
         index = CHAR_TO_INDEX(key[level]);
-        if (parent->next[index] == NULL) {
-            parent->next[index] = get_trienode();
+        if (t->nodes[parent].next[index] == NO_NODE) {
+            /* get_trienode may move the node vector */
+            uint32_t child = get_trienode(t);
+            t->nodes[parent].next[index] = child;
+        }
+
+        parent = t->nodes[parent].next[index];
+    }
+
+    /* Mark the last node as leaf */
+    if (t->nodes[parent].word == NO_WORD) {
+        t->nodes[parent].word = word;
+    }
+
+    return t->nodes[parent].word;
+}
+
+/*
+ * delete_trie
+ *
+ * Free the entire trie. All nodes live in one vector, so this
+ * never walks the individual nodes.
+ */
+void
+delete_trie(trie *t)
+{
+    free(t->nodes);
+    free(t->counts);
+    free(t);
+}
+
+/*
+ * words_sorted
+ *
+ * Returns true if the word list is in sort order, allowing
+ * repeated words.
+ */
+bool
+words_sorted(const word_list *list)
+{
+    uint32_t i;
+    for (i = 1; i < list->count; i++) {
+        if (strcmp(list->words[i - 1], list->words[i]) > 0) return false;
+    }
+
+    return true;
+}
+
+/*
+ * fill_trie
+ *
+ * Add all words of the word list to trie, each with its index in
+ * the list as word id. Repeated words are dropped from the list
+ * so the ids stay dense.
+ *
+ * Sorted lists are inserted in one pass: each word only adds the
+ * nodes below the longest prefix it shares with the previous word,
+ * which are all new. Returns true if the list was sorted, in which
+ * case the ids follow sort order.
+ */
+bool
+fill_trie(trie *t, word_list *list)
+{
+    uint32_t i, count = 0;
+
+    if (!words_sorted(list)) {
+        for (i = 0; i < list->count; i++) {
+            if (insert_trie(t, list->words[i], count) == count) {
+                list->words[count++] = list->words[i];
+            }
+        }
+
+        list->count = count;
+        return false;
+    }
+
+    /* path[i] is the node reached by the first i letters of prev */
+    uint32_t path[WORD_SIZE + 1];
+    const char *prev = "";
+    path[0] = TRIE_ROOT;
+
+    for (i = 0; i < list->count; i++) {
+        const char *key = list->words[i];
+        int level = 0;
+        while (key[level] != '\0' && key[level] == prev[level]) level++;
+        if (key[level] == '\0' && prev[level] == '\0') continue;
+
+        for (; key[level] != '\0'; level++) {
+            /* get_trienode may move the node vector */
+            uint32_t child = get_trienode(t);
+            t->nodes[path[level]].next[CHAR_TO_INDEX(key[level])] = child;
+            path[level + 1] = child;
+        }
+
+        t->nodes[path[level]].word = count;
+        list->words[count++] = list->words[i];
+        prev = key;
+    }
+
+    list->count = count;
+    return true;
+}
+
+/*
+ * fill_worker
+ *
+ * Thread body of fill_trie_parallel: build the trie of each letter's
+ * words until no letter is left.
+ */
+void *
+fill_worker(void *arg)
+{
+    fill_work *work = (fill_work *) arg;
+    int c;
+
+    while ((c = __sync_fetch_and_add(&work->next_letter, 1)) < ALPHABET_SIZE) {
+        word_list part;
+        part.pool = NULL;
+        part.words = work->list->words + work->start[c];
+        part.count = work->start[c + 1] - work->start[c];
+        part.offsets = NULL;
+
+        work->subs[c] = NULL;
+        work->kept[c] = 0;
+        work->sorted[c] = true;
+        if (part.count == 0) continue;
+
+        trie *sub = create_trie();
+        work->sorted[c] = fill_trie(sub, &part);
+        work->kept[c] = part.count;
+        work->subs[c] = sub;
+    }
+
+    return NULL;
+}
+
+/*
+ * fill_trie_parallel
+ *
+ * Same as fill_trie, using up to 'threads' threads. The list is
+ * grouped by first letter, keeping the order within each letter,
+ * and every letter's words are built into a trie of their own.
+ * The tries are then stitched under one root: the nodes of each
+ * go after those of the letters before it, and its word ids after
+ * theirs.
+ */
+bool
+fill_trie_parallel(trie *t, word_list *list, int threads)
+{
+    if (threads <= 1 || list->count < PARALLEL_MIN_WORDS) {
+        return fill_trie(t, list);
+    }
+
+    fill_work work;
+    memset(&work, 0, sizeof(work));
+    work.list = list;
+
+    uint32_t i, counts[ALPHABET_SIZE] = {0};
+    for (i = 0; i < list->count; i++) {
+        int c = CHAR_TO_INDEX(list->words[i][0]);
+        if (c < 0 || c >= ALPHABET_SIZE) return fill_trie(t, list);
+        counts[c]++;
+    }
+
+    int c;
+    for (c = 0; c < ALPHABET_SIZE; c++) {
+        work.start[c + 1] = work.start[c] + counts[c];
+        counts[c] = work.start[c];
+    }
+
+    /* a stable counting sort by first letter */
+    char **words = (char **) malloc((list->count + 1) * sizeof(char *));
+    if (words == NULL) {
+        printf("Error: Failed to allocate memory for Dictionary.\n");
+        exit(1);
+    }
+    for (i = 0; i < list->count; i++) {
+        words[counts[CHAR_TO_INDEX(list->words[i][0])]++] = list->words[i];
+    }
+    free(list->words);
+    list->words = words;
+
+    if (threads > ALPHABET_SIZE) threads = ALPHABET_SIZE;
+    pthread_t ids[ALPHABET_SIZE];
+    int n;
+    for (n = 0; n < threads; n++) {
+        if (pthread_create(&ids[n], NULL, fill_worker, &work) != 0) {
+            printf("Error: Failed to start a thread.\n");
+            exit(1);
+        }
+    }
+    for (n = 0; n < threads; n++) {
+        pthread_join(ids[n], NULL);
+    }
+
+    /* every trie brings all its nodes but the root */
+    uint32_t size = 1;
+    for (c = 0; c < ALPHABET_SIZE; c++) {
+        if (work.subs[c] != NULL) size += work.subs[c]->size - 1;
+    }
+    trie_node *nodes = (trie_node *) realloc(t->nodes,
+                                             size * sizeof(trie_node));
+    if (nodes == NULL) {
+        printf("Error: Failed to allocate memory for Trie.\n");
+        exit(1);
+    }
+    t->nodes = nodes;
+    t->size = size;
+    t->capacity = size;
+
+    uint32_t base = 1, word_base = 0;
+    bool ordered = true;
+    for (c = 0; c < ALPHABET_SIZE; c++) {
+        trie *sub = work.subs[c];
+        if (sub == NULL) continue;
+
+        /* node j > 0 of sub becomes node base + j - 1 */
+        uint32_t j;
+        for (j = 1; j < sub->size; j++) {
+            trie_node *node = &t->nodes[base + j - 1];
+            *node = sub->nodes[j];
+
+            int k;
+            for (k = 0; k < ALPHABET_SIZE; k++) {
+                if (node->next[k] != NO_NODE) node->next[k] += base - 1;
+            }
+            if (node->word != NO_WORD) node->word += word_base;
+        }
+        t->nodes[TRIE_ROOT].next[c] = sub->nodes[TRIE_ROOT].next[c] + base - 1;
+
+        memmove(list->words + word_base, list->words + work.start[c],
+                work.kept[c] * sizeof(char *));
+        word_base += work.kept[c];
+        base += sub->size - 1;
+        ordered = ordered && work.sorted[c];
+        delete_trie(sub);
+    }
+    list->count = word_base;
+
+    return ordered;
+}
+
+/*
+ * comparator
+ *
+ * Compares two words for sort order when sorting found words.
+ */
+int
+comparator(const void *word1, const void *word2)
+{
+    return strcmp(*(char **) word1, *(char **) word2);
+}
+
+/*
+ * id_comparator
+ *
+ * Compares two word ids for sort order.
+ */
+int
+id_comparator(const void *id1, const void *id2)
+{
+    uint32_t a = *(const uint32_t *) id1, b = *(const uint32_t *) id2;
+
+    return (a > b) - (a < b);
+}
+
+/*
+ * hash_trienode
+ *
+ * Hash a node's contents for the DAWG register.
+ */
+static uint32_t
+hash_trienode(const trie_node *node)
+{
+    uint32_t hash = node->word == NO_WORD ? 2166136261u : 84696351u;
+
+    int i;
+    for (i = 0; i < ALPHABET_SIZE; i++) {
+        hash = (hash ^ node->next[i]) * 16777619u;
+    }
+
+    return hash;
+}
+
+/*
+ * equal_trienode
+ *
+ * Returns true if both nodes accept the same suffixes, given that
+ * their children are already minimized.
+ */
+static bool
+equal_trienode(const trie_node *a, const trie_node *b)
+{
+    return a->word == b->word &&
+           memcmp(a->next, b->next, sizeof(a->next)) == 0;
+}
+
+/*
+ * dawg_register
+ *
+ * Returns the registered node equivalent to node, registering
+ * node itself if there is none yet.
+ */
+uint32_t
+dawg_register(dawg_builder *b, uint32_t node)
+{
+    trie_node *nodes = b->t->nodes;
+    uint32_t mask, i;
+
+    if (2 * (b->count + 1) > b->table_size) {
+        uint32_t size = b->table_size ? 2 * b->table_size : 1024;
+        uint32_t *table = (uint32_t *) calloc(size, sizeof(uint32_t));
+        if (table == NULL) {
+            printf("Error: Failed to allocate memory for DAWG.\n");
+            exit(1);
+        }
+
+        mask = size - 1;
+        for (i = 0; i < b->table_size; i++) {
+            uint32_t entry = b->table[i];
+            if (entry != NO_NODE) {
+                uint32_t slot = hash_trienode(&nodes[entry]) & mask;
+                while (table[slot] != NO_NODE) {
+                    slot = (slot + 1) & mask;
+                }
+                table[slot] = entry;
+            }
+        }
+
+        free(b->table);
+        b->table = table;
+        b->table_size = size;
+    }
+
+    mask = b->table_size - 1;
+    i = hash_trienode(&nodes[node]) & mask;
+    while (b->table[i] != NO_NODE) {
+        if (equal_trienode(&nodes[b->table[i]], &nodes[node])) {
+            return b->table[i];
         }
+        i = (i + 1) & mask;
+    }
+
+    b->table[i] = node;
+    b->count++;
+
+    return node;
+}
+
+/*
+ * dawg_minimize
+ *
+ * Close the nodes of the previous word below depth, replacing
+ * each by an equivalent registered node where one exists.
+ * Works from the deepest node up so children are always
+ * minimized before their parent is compared.
+ */
+void
+dawg_minimize(dawg_builder *b, int depth)
+{
+    trie_node *nodes = b->t->nodes;
+
+    int level;
+    for (level = b->prev_len; level > depth; level--) {
+        uint32_t node = b->path[level];
+        uint32_t same = dawg_register(b, node);
 
-        parent = parent->next[index];
+        if (same != node) {
+            int index = CHAR_TO_INDEX(b->prev[level - 1]);
+            nodes[b->path[level - 1]].next[index] = same;
+
+            nodes[node].next[0] = b->free_list;
+            b->free_list = node;
+        }
+    }
+}
+
+/*
+ * insert_dawg
+ *
+ * Insert a word into the DAWG. Words must arrive in sorted order,
+ * so the nodes the previous word does not share with this one
+ * will never change again and can be minimized now.
+ */
+void
+insert_dawg(dawg_builder *b, const char *key)
+{
+    trie *t = b->t;
+    int length = strlen(key);
+    int common = 0;
+
+    while (common < length && common < b->prev_len &&
+           key[common] == b->prev[common]) {
+        common++;
+    }
+
+    dawg_minimize(b, common);
+
+    int level;
+    for (level = common; level < length; level++) {
+        uint32_t child = b->free_list;
+        if (child != NO_NODE) {
+            b->free_list = t->nodes[child].next[0];
+            memset(t->nodes[child].next, 0, sizeof(t->nodes[child].next));
+            t->nodes[child].word = NO_WORD;
+        } else {
+            child = get_trienode(t);
+        }
+
+        t->nodes[b->path[level]].next[CHAR_TO_INDEX(key[level])] = child;
+        b->path[level + 1] = child;
+    }
+
+    t->nodes[b->path[length]].word = 0;
+
+    memcpy(b->prev, key, length);
+    b->prev_len = length;
+}
+
+/*
+ * freeze_trie
+ *
+ * Relocate the nodes of a fully built trie into a new vector in
+ * breadth first order, so the top levels every search goes through
+ * are contiguous and the children of a node are adjacent to each
+ * other. Nodes no longer reachable from the root are dropped and
+ * shared nodes are kept once. The vector is trimmed to size.
+ */
+void
+freeze_trie(trie *t)
+{
+    uint32_t *remap = (uint32_t *) malloc(t->size * sizeof(uint32_t));
+    uint32_t *order = (uint32_t *) malloc(t->size * sizeof(uint32_t));
+    if (remap == NULL || order == NULL) {
+        printf("Error: Failed to allocate memory for Trie.\n");
+        exit(1);
+    }
+
+    /* no node but the root maps to TRIE_ROOT, so it marks unvisited */
+    memset(remap, 0, t->size * sizeof(uint32_t));
+
+    uint32_t head, tail = 0;
+    order[tail++] = TRIE_ROOT;
+    for (head = 0; head < tail; head++) {
+        trie_node *node = &t->nodes[order[head]];
+
+        int i;
+        for (i = 0; i < ALPHABET_SIZE; i++) {
+            uint32_t child = node->next[i];
+            if (child != NO_NODE && remap[child] == TRIE_ROOT) {
+                remap[child] = tail;
+                order[tail++] = child;
+            }
+        }
+    }
+
+    trie_node *nodes = (trie_node *) malloc(tail * sizeof(trie_node));
+    if (nodes == NULL) {
+        printf("Error: Failed to allocate memory for Trie.\n");
+        exit(1);
+    }
+
+    for (head = 0; head < tail; head++) {
+        trie_node *node = &nodes[head];
+        *node = t->nodes[order[head]];
+
+        int i;
+        for (i = 0; i < ALPHABET_SIZE; i++) {
+            node->next[i] = remap[node->next[i]];
+        }
+    }
+
+    free(t->nodes);
+    free(remap);
+    free(order);
+
+    t->nodes = nodes;
+    t->size = tail;
+    t->capacity = tail;
+}
+
+/*
+ * word_fits
+ *
+ * Returns true if word can be spelled from the letters counted
+ * in inventory, each letter used at most as often as counted.
+ */
+bool
+word_fits(const char *word, const uint32_t *inventory)
+{
+    uint32_t used[ALPHABET_SIZE] = {0};
+
+    for (; *word != '\0'; word++) {
+        int index = CHAR_TO_INDEX(*word);
+        if (index < 0 || index >= ALPHABET_SIZE ||
+            ++used[index] > inventory[index]) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * input_read
+ *
+ * Read up to size bytes of the compressed input of job into
+ * buffer, which holds at least INPUT_MAGIC_SIZE bytes. Returns the
+ * number read, 0 at the end.
+ */
+size_t
+input_read(input_job *job, unsigned char *buffer, size_t size)
+{
+    if (job->prefix_size > 0) {
+        size_t n = job->prefix_size;
+        memcpy(buffer, job->prefix, n);
+        job->prefix_size = 0;
+        return n;
+    }
+
+    size_t n = fread(buffer, 1, size, job->in);
+    if (n == 0 && ferror(job->in)) {
+        printf("Error: Failed to read dictionary.\n");
+        exit(1);
+    }
+
+    return n;
+}
+
+/*
+ * input_write
+ *
+ * Write size bytes of decompressed text to the pipe of job.
+ */
+void
+input_write(input_job *job, const unsigned char *buffer, size_t size)
+{
+    while (size > 0) {
+        ssize_t n = write(job->out, buffer, size);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            printf("Error: Failed to read dictionary.\n");
+            exit(1);
+        }
+        buffer += n;
+        size -= n;
+    }
+}
+
+#ifdef HAVE_ZLIB
+/*
+ * input_gzip
+ *
+ * Decompress the gzip input of job, one member after another.
+ */
+void
+input_gzip(input_job *job)
+{
+    unsigned char in[INPUT_CHUNK], out[INPUT_CHUNK];
+    z_stream z;
+    memset(&z, 0, sizeof(z));
+
+    /* 16 + MAX_WBITS expects a gzip header */
+    if (inflateInit2(&z, 16 + MAX_WBITS) != Z_OK) {
+        printf("Error: Failed to allocate memory for Dictionary.\n");
+        exit(1);
+    }
+
+    bool done = false;
+    size_t n;
+    while ((n = input_read(job, in, sizeof(in))) > 0) {
+        z.next_in = in;
+        z.avail_in = n;
+
+        /* a full output buffer may leave output pending */
+        do {
+            z.next_out = out;
+            z.avail_out = sizeof(out);
+            int ret = inflate(&z, Z_NO_FLUSH);
+            if (ret == Z_STREAM_END) {
+                inflateReset(&z);
+                done = true;
+            } else if (ret == Z_OK) {
+                done = false;
+            } else if (ret != Z_BUF_ERROR) {
+                printf("Error: Corrupt compressed dictionary.\n");
+                exit(1);
+            }
+            input_write(job, out, sizeof(out) - z.avail_out);
+        } while (z.avail_in > 0 || z.avail_out == 0);
+    }
+
+    if (!done) {
+        printf("Error: Truncated compressed dictionary.\n");
+        exit(1);
+    }
+    inflateEnd(&z);
+}
+#endif
+
+#ifdef HAVE_ZSTD
+/*
+ * input_zstd
+ *
+ * Decompress the zstd input of job, one frame after another.
+ */
+void
+input_zstd(input_job *job)
+{
+    unsigned char in[INPUT_CHUNK], out[INPUT_CHUNK];
+    ZSTD_DStream *zs = ZSTD_createDStream();
+    if (zs == NULL || ZSTD_isError(ZSTD_initDStream(zs))) {
+        printf("Error: Failed to allocate memory for Dictionary.\n");
+        exit(1);
+    }
+
+    /* left is 0 once a frame is complete */
+    size_t n, left = 1;
+    while ((n = input_read(job, in, sizeof(in))) > 0) {
+        ZSTD_inBuffer input = { in, n, 0 };
+        bool full;
+
+        /* a full output buffer may leave output pending */
+        do {
+            ZSTD_outBuffer output = { out, sizeof(out), 0 };
+            left = ZSTD_decompressStream(zs, &output, &input);
+            if (ZSTD_isError(left)) {
+                printf("Error: Corrupt compressed dictionary.\n");
+                exit(1);
+            }
+            input_write(job, out, output.pos);
+            full = output.pos == output.size;
+        } while (input.pos < input.size || full);
+    }
+
+    if (left != 0) {
+        printf("Error: Truncated compressed dictionary.\n");
+        exit(1);
+    }
+    ZSTD_freeDStream(zs);
+}
+#endif
+
+/*
+ * input_worker
+ *
+ * Thread body of open_input: decompress the input of job into its
+ * pipe, and close the pipe at the end.
+ */
+void *
+input_worker(void *arg)
+{
+    input_job *job = (input_job *) arg;
+
+    switch (job->format) {
+#ifdef HAVE_ZLIB
+    case INPUT_GZIP:
+        input_gzip(job);
+        break;
+#endif
+#ifdef HAVE_ZSTD
+    case INPUT_ZSTD:
+        input_zstd(job);
+        break;
+#endif
+    default: {
+        unsigned char buffer[INPUT_CHUNK];
+        size_t n;
+        while ((n = input_read(job, buffer, sizeof(buffer))) > 0) {
+            input_write(job, buffer, n);
+        }
+    }
+    }
+
+    close(job->out);
+    return NULL;
+}
+
+/*
+ * open_input
+ *
+ * Returns the file to read the text of dictionary file fp from. A
+ * gzip or zstd compressed file, known by its magic bytes, is
+ * decompressed by a thread writing to a pipe, which is returned;
+ * close it with close_input. A plain file is returned as it is.
+ */
+FILE *
+open_input(FILE *fp, input_job *job)
+{
+    static const unsigned char gzip_magic[] = { 0x1f, 0x8b };
+    static const unsigned char zstd_magic[] = { 0x28, 0xb5, 0x2f, 0xfd };
+
+    job->running = false;
+
+    /* neither magic starts with a letter, so most files are known
+       plain from their first byte */
+    int c = getc(fp);
+    if (c == EOF) return fp;
+    ungetc(c, fp);
+    if (c != gzip_magic[0] && c != zstd_magic[0]) return fp;
+
+    job->prefix_size = fread(job->prefix, 1, INPUT_MAGIC_SIZE, fp);
+    if (job->prefix_size >= sizeof(gzip_magic) &&
+        memcmp(job->prefix, gzip_magic, sizeof(gzip_magic)) == 0) {
+        job->format = INPUT_GZIP;
+    } else if (job->prefix_size >= sizeof(zstd_magic) &&
+               memcmp(job->prefix, zstd_magic, sizeof(zstd_magic)) == 0) {
+        job->format = INPUT_ZSTD;
+    } else {
+        job->format = INPUT_PLAIN;
+
+        /* a pipe cannot go back, so its bytes go through the thread */
+        if (fseek(fp, -(long) job->prefix_size, SEEK_CUR) == 0) return fp;
+    }
+
+#ifndef HAVE_ZLIB
+    if (job->format == INPUT_GZIP) {
+        printf("Error: Built without gzip support (-DHAVE_ZLIB).\n");
+        exit(1);
+    }
+#endif
+#ifndef HAVE_ZSTD
+    if (job->format == INPUT_ZSTD) {
+        printf("Error: Built without zstd support (-DHAVE_ZSTD).\n");
+        exit(1);
+    }
+#endif
+
+    int fds[2];
+    if (pipe(fds) != 0) {
+        printf("Error: Failed to read dictionary.\n");
+        exit(1);
+    }
+
+    job->in = fp;
+    job->out = fds[1];
+    if (pthread_create(&job->thread, NULL, input_worker, job) != 0) {
+        printf("Error: Failed to start a thread.\n");
+        exit(1);
+    }
+    job->running = true;
+
+    FILE *in = fdopen(fds[0], "r");
+    if (in == NULL) {
+        printf("Error: Failed to read dictionary.\n");
+        exit(1);
+    }
+
+    return in;
+}
+
+/*
+ * close_input
+ *
+ * Finish with file 'in' returned by open_input for job.
+ */
+void
+close_input(FILE *in, input_job *job)
+{
+    if (!job->running) return;
+
+    pthread_join(job->thread, NULL);
+    fclose(in);
+}
+
+/*
+ * letter_table
+ *
+ * Returns the table words are normalized with: upper case letters
+ * map to themselves, lower case letters to upper case and every
+ * other byte to 0.
+ */
+const unsigned char *
+letter_table(void)
+{
+    static unsigned char table[256];
+
+    if (table['A'] == 0) {
+        int c;
+        for (c = 0; c < ALPHABET_SIZE; c++) {
+            table['A' + c] = 'A' + c;
+            table['a' + c] = 'A' + c;
+        }
+    }
+
+    return table;
+}
+
+/*
+ * read_words
+ *
+ * Read all words from dictionary file into a word list. The file
+ * is read into one buffer a chunk at a time, and the lines read so
+ * far are split with memchr after each chunk; each word is
+ * terminated in place, so the buffer becomes the word pool. Lines
+ * may end in CRLF, and the last one needs no newline. Compressed
+ * files are decompressed on another thread as the lines are split
+ * (see open_input).
+ *
+ * Words are upper cased through letter_table as they are split.
+ * Lines with anything but letters, such as apostrophes or UTF-8,
+ * and words of WORD_SIZE letters or more are skipped and counted
+ * on stderr; empty lines are skipped silently. If inventory is not
+ * NULL, so are words that cannot be spelled from its letter counts.
+ */
+word_list *
+read_words(FILE *fp, const uint32_t *inventory)
+{
+    input_job job;
+    FILE *in = open_input(fp, &job);
+
+    /* pool holds the bytes read so far, with a spare byte after
+       them; start is where the first line not split yet begins */
+    size_t size = 0, start = 0, pool_capacity = READ_CHUNK;
+    struct stat st;
+    if (fstat(fileno(in), &st) == 0 && S_ISREG(st.st_mode)) {
+        pool_capacity = st.st_size + 2;
+    }
+    char *pool = NULL;
+
+    size_t *offsets = NULL;
+    uint32_t count = 0, capacity = 0;
+    uint32_t invalid = 0, too_long = 0;
+    const unsigned char *table = letter_table();
+
+    /* kept words are moved down to 'keep', closing the gaps that
+       line ends and skipped words leave */
+    size_t keep = 0;
+    bool eof = false;
+    while (!eof) {
+        if (pool == NULL || pool_capacity - size < 2) {
+            if (pool != NULL) pool_capacity *= 2;
+            pool = (char *) realloc(pool, pool_capacity);
+            if (pool == NULL) {
+                printf("Error: Failed to allocate memory for Dictionary.\n");
+                exit(1);
+            }
+        }
+
+        size_t want = pool_capacity - size - 1;
+        if (want > READ_CHUNK) want = READ_CHUNK;
+        size_t n = fread(pool + size, 1, want, in);
+        size += n;
+        eof = n == 0;
+        if (eof && ferror(in)) {
+            printf("Error: Failed to read dictionary.\n");
+            exit(1);
+        }
+
+        /* split the whole lines read so far, and at the end the last
+           line, which may have no newline */
+        while (start < size) {
+            char *line = pool + start;
+            char *newline = (char *) memchr(line, '\n', size - start);
+            if (newline == NULL) {
+                if (!eof) break;
+                newline = pool + size;
+            }
+
+            size_t length = newline - line;
+            if (length > 0 && line[length - 1] == '\r') length--;
+            line[length] = '\0';
+
+            /* no branch per letter; a 0 from the table spoils the line */
+            unsigned char valid = 1;
+            size_t j;
+            for (j = 0; j < length; j++) {
+                unsigned char c = table[(unsigned char) line[j]];
+                line[j] = c;
+                valid &= c != 0;
+            }
+
+            if (!valid) {
+                invalid++;
+            } else if (length >= WORD_SIZE) {
+                too_long++;
+            } else if (length > 0 &&
+                       (inventory == NULL || word_fits(line, inventory))) {
+                if (count == capacity) {
+                    capacity = capacity ? 2 * capacity : 4096;
+                    offsets = (size_t *) realloc(offsets,
+                                                 capacity * sizeof(size_t));
+                    if (offsets == NULL) {
+                        printf("Error: Failed to allocate memory for"
+                               " Dictionary.\n");
+                        exit(1);
+                    }
+                }
+
+                if (keep != start) memmove(pool + keep, line, length + 1);
+                offsets[count++] = keep;
+                keep += length + 1;
+            }
+
+            start = newline - pool + 1;
+        }
+    }
+    close_input(in, &job);
+
+    if (invalid > 0 || too_long > 0) {
+        fprintf(stderr, "Skipped %u dictionary lines: %u with characters"
+                " other than letters, %u of %d letters or more.\n",
+                invalid + too_long, invalid, too_long, WORD_SIZE);
+    }
+
+    /* give back what the gaps and skipped words took */
+    if (keep > 0) {
+        char *shrunk = (char *) realloc(pool, keep);
+        if (shrunk != NULL) pool = shrunk;
+    }
+
+    word_list *list = (word_list *) malloc(sizeof(word_list));
+    char **words = (char **) malloc((count + 1) * sizeof(char *));
+    if (list == NULL || words == NULL) {
+        printf("Error: Failed to allocate memory for Dictionary.\n");
+        exit(1);
+    }
+
+    /* the pool no longer moves, so offsets can become pointers */
+    uint32_t i;
+    for (i = 0; i < count; i++) {
+        words[i] = pool + offsets[i];
+    }
+    free(offsets);
+
+    list->pool = pool;
+    list->words = words;
+    list->count = count;
+    list->offsets = NULL;
+
+    return list;
+}
+
+/*
+ * sort_words
+ *
+ * Sort the word list, unless it is sorted already, and drop
+ * duplicate words.
+ */
+void
+sort_words(word_list *list)
+{
+    if (list->count == 0) return;
+
+    /* dictionaries mostly come sorted already */
+    if (!words_sorted(list)) {
+        qsort(list->words, list->count, sizeof(char *), comparator);
+    }
+
+    uint32_t i, unique = 1;
+    for (i = 1; i < list->count; i++) {
+        if (strcmp(list->words[i], list->words[unique - 1]) != 0) {
+            list->words[unique++] = list->words[i];
+        }
+    }
+    list->count = unique;
+}
+
+/*
+ * image_corrupt
+ *
+ * Report that a dictionary image is damaged and exit.
+ */
+void
+image_corrupt(void)
+{
+    printf("Error: Corrupt dictionary image.\n");
+    exit(1);
+}
+
+/*
+ * word_text
+ *
+ * Returns the word with the given id.
+ */
+static inline const char *
+word_text(const word_list *list, uint32_t id)
+{
+    if (list->words) return list->words[id];
+
+    /* map_dict made sure the pool ends in a NUL */
+    if (list->offsets[id] >= list->pool_size) image_corrupt();
+    return list->pool + list->offsets[id];
+}
+
+/*
+ * delete_words
+ *
+ * Free the word list.
+ */
+void
+delete_words(word_list *list)
+{
+    free(list->pool);
+    free(list->words);
+    free(list);
+}
+
+/*
+ * count_dawg_words
+ *
+ * Set counts[i] of DAWG t to the number of words continuing from
+ * node i. Shared nodes are counted once, walking the DAWG depth
+ * first with an explicit stack as deep as the longest word.
+ */
+void
+count_dawg_words(trie *t)
+{
+    uint32_t stack[WORD_SIZE + 1];
+    int letter[WORD_SIZE + 1];
+    int top = 0;
+
+    t->counts = (uint32_t *) malloc(t->size * sizeof(uint32_t));
+    if (t->counts == NULL) {
+        printf("Error: Failed to allocate memory for DAWG.\n");
+        exit(1);
+    }
+
+    /* NO_WORD marks nodes not counted yet */
+    memset(t->counts, 0xff, t->size * sizeof(uint32_t));
+
+    stack[0] = TRIE_ROOT;
+    letter[0] = 0;
+    while (top >= 0) {
+        trie_node *node = &t->nodes[stack[top]];
+
+        /* descend into the next child not counted yet */
+        while (letter[top] < ALPHABET_SIZE &&
+               (node->next[letter[top]] == NO_NODE ||
+                t->counts[node->next[letter[top]]] != NO_WORD)) {
+            letter[top]++;
+        }
+        if (letter[top] < ALPHABET_SIZE) {
+            stack[top + 1] = node->next[letter[top]];
+            letter[top + 1] = 0;
+            top++;
+            continue;
+        }
+
+        uint32_t count = node->word != NO_WORD;
+        int i;
+        for (i = 0; i < ALPHABET_SIZE; i++) {
+            if (node->next[i] != NO_NODE) count += t->counts[node->next[i]];
+        }
+        t->counts[stack[top--]] = count;
+    }
+}
+
+/*
+ * fill_dawg
+ *
+ * Build trie t as a minimal DAWG of the words in list, which must
+ * be sorted without duplicates: words sharing a suffix share its
+ * nodes. A word's id is its index in the sorted list.
+ */
+void
+fill_dawg(trie *t, const word_list *list)
+{
+    dawg_builder b;
+    memset(&b, 0, sizeof(b));
+    b.t = t;
+    b.path[0] = TRIE_ROOT;
+
+    uint32_t i;
+    for (i = 0; i < list->count; i++) {
+        insert_dawg(&b, list->words[i]);
+    }
+    dawg_minimize(&b, 0);
+
+    free(b.table);
+
+    freeze_trie(t);
+    count_dawg_words(t);
+}
+
+/*
+ * summary_init
+ *
+ * Start the summary of a node as if it had no children.
+ */
+static void
+summary_init(node_summary *summary)
+{
+    summary->need = ALL_LETTERS;
+    summary->has = 0;
+    summary->min_len = UINT16_MAX;
+    summary->max_len = 0;
+}
+
+/*
+ * summary_add_child
+ *
+ * Add the continuations through the child for letter index to
+ * the summary of its parent. child_ends tells if the child ends
+ * a word itself.
+ */
+static void
+summary_add_child(node_summary *parent, const node_summary *child,
+                  bool child_ends, int index)
+{
+    uint32_t bit = 1u << index;
+    uint16_t min_len = child_ends ? 1 : child->min_len + 1;
+
+    parent->need &= bit | (child_ends ? 0 : child->need);
+    parent->has |= bit | child->has;
+    if (min_len < parent->min_len) parent->min_len = min_len;
+    if (child->max_len + 1 > parent->max_len) {
+        parent->max_len = child->max_len + 1;
+    }
+}
+
+/*
+ * summary_finish
+ *
+ * Complete the summary of a node once all children are added.
+ */
+static void
+summary_finish(node_summary *summary)
+{
+    if (summary->max_len == 0) summary->need = 0;
+}
+
+/*
+ * summarize_trie
+ *
+ * Returns the summaries of all nodes of trie t, indexed by node.
+ * Works on DAWGs too, since a node's summary only depends on the
+ * words below it. Walks depth first with an explicit stack as deep
+ * as the longest word, summarizing each node after its children.
+ */
+node_summary *
+summarize_trie(trie *t)
+{
+    uint32_t stack[WORD_SIZE + 1];
+    int letter[WORD_SIZE + 1];
+    int top = 0;
+
+    node_summary *summary = (node_summary *) malloc(t->size *
+                                                    sizeof(node_summary));
+    uint8_t *done = (uint8_t *) calloc(t->size, 1);
+    if (summary == NULL || done == NULL) {
+        printf("Error: Failed to allocate memory for Trie Summary.\n");
+        exit(1);
+    }
+
+    stack[0] = TRIE_ROOT;
+    letter[0] = 0;
+    while (top >= 0) {
+        trie_node *node = &t->nodes[stack[top]];
+
+        /* descend into the next child not summarized yet */
+        while (letter[top] < ALPHABET_SIZE &&
+               (node->next[letter[top]] == NO_NODE ||
+                done[node->next[letter[top]]])) {
+            letter[top]++;
+        }
+        if (letter[top] < ALPHABET_SIZE) {
+            stack[top + 1] = node->next[letter[top]];
+            letter[top + 1] = 0;
+            top++;
+            continue;
+        }
+
+        node_summary *at = &summary[stack[top]];
+        summary_init(at);
+
+        int i;
+        for (i = 0; i < ALPHABET_SIZE; i++) {
+            uint32_t child = node->next[i];
+            if (child != NO_NODE) {
+                summary_add_child(at, &summary[child],
+                                  t->nodes[child].word != NO_WORD, i);
+            }
+        }
+        summary_finish(at);
+
+        done[stack[top--]] = 1;
+    }
+
+    free(done);
+
+    return summary;
+}
+
+/*
+ * remap_summary
+ *
+ * Returns the summaries for a representation with 'size' nodes
+ * built from a trie, where source[i] is the trie node node i was
+ * built from.
+ */
+node_summary *
+remap_summary(const node_summary *summary, const uint32_t *source,
+              uint32_t size)
+{
+    node_summary *remapped = (node_summary *) malloc(size *
+                                                     sizeof(node_summary));
+    if (remapped == NULL) {
+        printf("Error: Failed to allocate memory for Trie Summary.\n");
+        exit(1);
+    }
+
+    uint32_t i;
+    for (i = 0; i < size; i++) {
+        remapped[i] = summary[source[i]];
+    }
+
+    return remapped;
+}
+
+/*
+ * create_sparse_trie
+ *
+ * Build the sparse representation of trie t. Nodes are laid out
+ * breadth first, so each node's children form one packed run.
+ *
+ * If source is not NULL it receives an array giving for every
+ * sparse node the trie node it was built from.
+ */
+sparse_trie *
+create_sparse_trie(trie *t, uint32_t **source)
+{
+    sparse_trie *st = (sparse_trie *) malloc(sizeof(sparse_trie));
+    uint32_t *order = (uint32_t *) malloc(t->size * sizeof(uint32_t));
+    if (st == NULL || order == NULL) {
+        printf("Error: Failed to allocate memory for Sparse Trie.\n");
+        exit(1);
+    }
+
+    st->size = t->size;
+    st->nodes = (sparse_node *) malloc(t->size * sizeof(sparse_node));
+    if (st->nodes == NULL) {
+        printf("Error: Failed to allocate memory for Sparse Trie.\n");
+        exit(1);
+    }
+
+    /* order[] is the breadth first queue; a node's position in it is
+       its index in the sparse trie. */
+    uint32_t head, tail = 0;
+    order[tail++] = TRIE_ROOT;
+    for (head = 0; head < tail; head++) {
+        trie_node *node = &t->nodes[order[head]];
+        sparse_node *packed = &st->nodes[head];
+
+        packed->mask = 0;
+        packed->first = tail;
+        packed->word = node->word;
+
+        int i;
+        for (i = 0; i < ALPHABET_SIZE; i++) {
+            if (node->next[i] != NO_NODE) {
+                packed->mask |= 1u << i;
+                order[tail++] = node->next[i];
+            }
+        }
+    }
+
+    if (source != NULL) {
+        *source = order;
+    } else {
+        free(order);
+    }
+
+    return st;
+}
+
+/*
+ * delete_sparse_trie
+ *
+ * Free the sparse trie.
+ */
+void
+delete_sparse_trie(sparse_trie *st)
+{
+    free(st->nodes);
+    free(st);
+}
+
+/*
+ * da_reserve
+ *
+ * Grow the double array so slots up to limit (exclusive) exist.
+ * New slots are free.
+ */
+void
+da_reserve(double_array *da, uint32_t **free_next, uint32_t limit)
+{
+    if (limit <= da->size) return;
+
+    uint32_t size = da->size ? da->size : 1024;
+    while (size < limit) size *= 2;
+
+    da->base = (uint32_t *) realloc(da->base, size * sizeof(uint32_t));
+    da->check = (uint32_t *) realloc(da->check, size * sizeof(uint32_t));
+    da->word = (uint32_t *) realloc(da->word, size * sizeof(uint32_t));
+    *free_next = (uint32_t *) realloc(*free_next, size * sizeof(uint32_t));
+    if (da->base == NULL || da->check == NULL || da->word == NULL ||
+        *free_next == NULL) {
+        printf("Error: Failed to allocate memory for Double Array.\n");
+        exit(1);
+    }
+
+    memset(da->base + da->size, 0, (size - da->size) * sizeof(uint32_t));
+    memset(da->check + da->size, 0xff, (size - da->size) * sizeof(uint32_t));
+    memset(da->word + da->size, 0xff, (size - da->size) * sizeof(uint32_t));
+
+    uint32_t i;
+    for (i = da->size; i < size; i++) {
+        (*free_next)[i] = i;
+    }
+    da->size = size;
+}
+
+/*
+ * da_find_free
+ *
+ * Returns the first free slot at or after slot. free_next[i] is i
+ * for a free slot and points further on for a used one; lookups
+ * shorten the chains they walk.
+ */
+static uint32_t
+da_find_free(uint32_t *free_next, uint32_t slot)
+{
+    while (free_next[slot] != slot) {
+        free_next[slot] = free_next[free_next[slot]];
+        slot = free_next[slot];
+    }
+
+    return slot;
+}
+
+/*
+ * create_double_array
+ *
+ * Build the double-array representation of trie t. Nodes are
+ * placed breadth first; each node's children go at the first base
+ * where all of their slots are free.
+ *
+ * If source is not NULL it receives an array giving for every
+ * state the trie node it was built from (TRIE_ROOT for free slots).
+ */
+double_array *
+create_double_array(trie *t, uint32_t **source)
+{
+    double_array *da = (double_array *) malloc(sizeof(double_array));
+    uint32_t *queue = (uint32_t *) malloc(2 * t->size * sizeof(uint32_t));
+    if (da == NULL || queue == NULL) {
+        printf("Error: Failed to allocate memory for Double Array.\n");
+        exit(1);
+    }
+
+    da->base = NULL;
+    da->check = NULL;
+    da->word = NULL;
+    da->size = 0;
+
+    /* free_next[] tracks occupied slots, including ones whose state
+       has no children and so is never a check[] target */
+    uint32_t *free_next = NULL;
+    da_reserve(da, &free_next, t->size + 2 * ALPHABET_SIZE);
+    free_next[0] = 1;
+
+    /* queue holds (trie node, state) pairs */
+    uint32_t head, tail = 0, end = 1;
+    queue[tail++] = TRIE_ROOT;
+    queue[tail++] = 0;
+    for (head = 0; head < tail; head += 2) {
+        trie_node *node = &t->nodes[queue[head]];
+        uint32_t state = queue[head + 1];
+        int letters[ALPHABET_SIZE];
+        int count = 0;
+
+        int i;
+        for (i = 0; i < ALPHABET_SIZE; i++) {
+            if (node->next[i] != NO_NODE) letters[count++] = i;
+        }
+
+        uint32_t base = 0;
+        if (count > 0) {
+            /* Try each free slot in turn for the first child until
+               the other children's slots are free as well. */
+            uint32_t pos = da_find_free(free_next, 1);
+            for (;;) {
+                da_reserve(da, &free_next, pos + 2 * ALPHABET_SIZE);
+
+                /* base stays above 0 so no child lands on the root */
+                if (pos > (uint32_t) letters[0]) {
+                    base = pos - letters[0];
+                    for (i = 1; i < count; i++) {
+                        uint32_t slot = base + letters[i];
+                        if (free_next[slot] != slot) break;
+                    }
+                    if (i == count) break;
+                }
+
+                pos = da_find_free(free_next, pos + 1);
+            }
+
+            for (i = 0; i < count; i++) {
+                uint32_t slot = base + letters[i];
+                free_next[slot] = slot + 1;
+                da->check[slot] = state;
+                queue[tail++] = node->next[letters[i]];
+                queue[tail++] = slot;
+                if (slot + 1 > end) end = slot + 1;
+            }
+        }
+
+        da->base[state] = base | (node->word != NO_WORD ? DA_END : 0);
+        da->word[state] = node->word;
+    }
+
+    /* Trim to the last used slot plus the padding transitions need. */
+    da->size = end + ALPHABET_SIZE;
+    da->base = (uint32_t *) realloc(da->base, da->size * sizeof(uint32_t));
+    da->check = (uint32_t *) realloc(da->check, da->size * sizeof(uint32_t));
+    da->word = (uint32_t *) realloc(da->word, da->size * sizeof(uint32_t));
+
+    free(free_next);
+
+    if (source != NULL) {
+        *source = (uint32_t *) calloc(da->size, sizeof(uint32_t));
+        if (*source == NULL) {
+            printf("Error: Failed to allocate memory for Double Array.\n");
+            exit(1);
+        }
+        for (head = 0; head < tail; head += 2) {
+            (*source)[queue[head + 1]] = queue[head];
+        }
+    }
+    free(queue);
+
+    return da;
+}
+
+/*
+ * delete_double_array
+ *
+ * Free the double array.
+ */
+void
+delete_double_array(double_array *da)
+{
+    free(da->base);
+    free(da->check);
+    free(da->word);
+    free(da);
+}
+
+/*
+ * louds_reserve
+ *
+ * Grow the LOUDS trie arrays to hold at least 'nodes' nodes.
+ */
+void
+louds_reserve(louds_trie *lt, uint32_t *capacity, uint32_t nodes)
+{
+    if (nodes <= *capacity) return;
+
+    uint32_t old = *capacity;
+    uint32_t size = old ? 2 * old : 4096;
+    while (size < nodes) size *= 2;
+
+    /* 2 * size bits for the runs, rounded up to whole words */
+    lt->bits = (uint64_t *) realloc(lt->bits, (size / 32 + 1) * 8);
+    lt->is_end = (uint64_t *) realloc(lt->is_end, (size / 64 + 1) * 8);
+    lt->select_hint = (uint32_t *) realloc(lt->select_hint,
+                                           (size / LOUDS_SELECT_STEP + 1) *
+                                           sizeof(uint32_t));
+    lt->labels = (uint8_t *) realloc(lt->labels, size);
+    if (lt->bits == NULL || lt->is_end == NULL ||
+        lt->select_hint == NULL || lt->labels == NULL) {
+        printf("Error: Failed to allocate memory for LOUDS Trie.\n");
+        exit(1);
+    }
+
+    uint32_t from = old ? old / 32 + 1 : 0;
+    memset(lt->bits + from, 0, (size / 32 + 1 - from) * 8);
+    from = old ? old / 64 + 1 : 0;
+    memset(lt->is_end + from, 0, (size / 64 + 1 - from) * 8);
+    *capacity = size;
+}
+
+/*
+ * create_louds_trie
+ *
+ * Build the LOUDS representation of the words in list, which must
+ * be sorted without duplicates. The nodes of each level are runs of
+ * words sharing a prefix, so the trie is built level by level from
+ * the list alone, never holding more than two levels of runs.
+ *
+ * The list is reordered to match the word ids, which follow the
+ * breadth first order of the end nodes.
+ *
+ * If summary is not NULL it receives the summaries of all nodes.
+ */
+louds_trie *
+create_louds_trie(word_list *list, node_summary **summary)
+{
+    louds_trie *lt = (louds_trie *) calloc(1, sizeof(louds_trie));
+    char **words = (char **) malloc((list->count + 1) * sizeof(char *));
+    if (lt == NULL || words == NULL) {
+        printf("Error: Failed to allocate memory for LOUDS Trie.\n");
+        exit(1);
+    }
+
+    /* level[] holds the [start, end) word ranges of the nodes on the
+       current level, next_level[] those of their children */
+    uint32_t *level = (uint32_t *) malloc(2 * sizeof(uint32_t));
+    uint32_t *next_level = NULL;
+    uint32_t level_size = 1, level_capacity = 1;
+    uint32_t next_size, next_capacity = 0;
+    if (level == NULL) {
+        printf("Error: Failed to allocate memory for LOUDS Trie.\n");
+        exit(1);
+    }
+    level[0] = 0;
+    level[1] = list->count;
+
+    uint32_t capacity = 0, node = 0, tail = 1, ends = 0;
+    size_t pos = 0;
+
+    /* parent[j] is the parent of node j, kept only for summaries */
+    uint32_t *parent = NULL, parent_capacity = 0;
+    int depth = 0;
+    louds_reserve(lt, &capacity, 1);
+
+    while (level_size > 0) {
+        next_size = 0;
+
+        uint32_t r;
+        for (r = 0; r < level_size; r++, node++) {
+            uint32_t start = level[2 * r], end = level[2 * r + 1];
+
+            /* sorted, so a word ending here comes first in its run */
+            if (start < end && list->words[start][depth] == '\0') {
+                lt->is_end[node / 64] |= (uint64_t) 1 << (node % 64);
+                words[ends++] = list->words[start];
+                start++;
+            }
+
+            while (start < end) {
+                char c = list->words[start][depth];
+                uint32_t stop = start + 1;
+                while (stop < end && list->words[stop][depth] == c) stop++;
+
+                louds_reserve(lt, &capacity, tail + 1);
+                if (summary != NULL && parent_capacity < capacity) {
+                    parent_capacity = capacity;
+                    parent = (uint32_t *) realloc(parent, parent_capacity *
+                                                  sizeof(uint32_t));
+                    if (parent == NULL) {
+                        printf("Error: Failed to allocate memory for"
+                               " LOUDS Trie.\n");
+                        exit(1);
+                    }
+                }
+                if (next_size == next_capacity) {
+                    next_capacity = next_capacity ? 2 * next_capacity : 1024;
+                    next_level = (uint32_t *) realloc(next_level,
+                                     2 * next_capacity * sizeof(uint32_t));
+                    if (next_level == NULL) {
+                        printf("Error: Failed to allocate memory for"
+                               " LOUDS Trie.\n");
+                        exit(1);
+                    }
+                }
+
+                lt->bits[pos / 64] |= (uint64_t) 1 << (pos % 64);
+                pos++;
+                lt->labels[tail - 1] = CHAR_TO_INDEX(c);
+                if (parent != NULL) parent[tail] = node;
+                tail++;
+                next_level[2 * next_size] = start;
+                next_level[2 * next_size + 1] = stop;
+                next_size++;
+
+                start = stop;
+            }
+
+            /* the 0 bit closing this node's run */
+            if (node % LOUDS_SELECT_STEP == 0) {
+                lt->select_hint[node / LOUDS_SELECT_STEP] = pos;
+            }
+            pos++;
+        }
+
+        uint32_t *swap = level;
+        level = next_level;
+        next_level = swap;
+
+        uint32_t swap_capacity = level_capacity;
+        level_capacity = next_capacity;
+        next_capacity = swap_capacity;
+        level_size = next_size;
+        depth++;
+    }
+
+    free(level);
+    free(next_level);
+
+    lt->size = node;
+
+    free(list->words);
+    list->words = words;
+
+    uint32_t i, count = 0;
+    lt->end_rank = (uint32_t *) malloc((node / 64 + 1) * sizeof(uint32_t));
+    if (lt->end_rank == NULL) {
+        printf("Error: Failed to allocate memory for LOUDS Trie.\n");
+        exit(1);
+    }
+    for (i = 0; i <= node / 64; i++) {
+        lt->end_rank[i] = count;
+        count += __builtin_popcountll(lt->is_end[i]);
+    }
+
+    if (summary != NULL) {
+        *summary = (node_summary *) malloc(node * sizeof(node_summary));
+        if (*summary == NULL) {
+            printf("Error: Failed to allocate memory for Trie Summary.\n");
+            exit(1);
+        }
+        for (i = 0; i < node; i++) {
+            summary_init(&(*summary)[i]);
+        }
+
+        /* children come after their parent in breadth first order, so
+           going backwards every node is complete before its parent
+           takes it in */
+        for (i = node - 1; i > 0; i--) {
+            bool ends = lt->is_end[i / 64] & ((uint64_t) 1 << (i % 64));
+            summary_finish(&(*summary)[i]);
+            summary_add_child(&(*summary)[parent[i]], &(*summary)[i],
+                              ends, lt->labels[i - 1]);
+        }
+        summary_finish(&(*summary)[0]);
+    }
+    free(parent);
+
+    return lt;
+}
+
+/*
+ * delete_louds_trie
+ *
+ * Free the LOUDS trie.
+ */
+void
+delete_louds_trie(louds_trie *lt)
+{
+    free(lt->bits);
+    free(lt->is_end);
+    free(lt->end_rank);
+    free(lt->select_hint);
+    free(lt->labels);
+    free(lt);
+}
+
+/*
+ * louds_select0
+ *
+ * Returns the position of 0 bit number k (counting from 0).
+ * Starts at the nearest select hint and counts 0 bits a word
+ * at a time from there. If checked is set, the bits came from an
+ * image and are not trusted to stay within lt->bits.
+ */
+static inline size_t
+louds_select0(const louds_trie *lt, uint32_t k, bool checked)
+{
+    size_t pos = lt->select_hint[k / LOUDS_SELECT_STEP];
+    uint32_t left = k % LOUDS_SELECT_STEP;
+    if (left == 0) return pos;
+
+    /* 0 bits after pos in its word */
+    size_t words = lt->size / 32 + 1;
+    size_t word = pos / 64;
+    if (checked && word >= words) image_corrupt();
+    uint64_t zeros = ~lt->bits[word] & (~(uint64_t) 0 << (pos % 64) << 1);
+
+    for (;;) {
+        uint32_t count = __builtin_popcountll(zeros);
+        if (count >= left) break;
+        left -= count;
+        if (checked && word + 1 >= words) image_corrupt();
+        zeros = ~lt->bits[++word];
+    }
+
+    while (--left) zeros &= zeros - 1;
+
+    return word * 64 + __builtin_ctzll(zeros);
+}
+
+/*
+ * louds_child
+ *
+ * Returns the child of node for letter index, or NO_NODE. If checked
+ * is set, the trie came from an image and the children it gives are
+ * checked to be nodes.
+ */
+static inline uint32_t
+louds_child(const louds_trie *lt, uint32_t node, int index, bool checked)
+{
+    /* node's run of 1 bits starts just after the 0 bit closing the
+       previous node's run */
+    size_t pos = node ? louds_select0(lt, node - 1, checked) + 1 : 0;
+
+    /* Every bit before pos that is not one of the node 0 bits is an
+       edge, so that many nodes precede node's first child. */
+    uint32_t first = pos - node + 1;
+
+    size_t words = lt->size / 32 + 1;
+    size_t word = pos / 64;
+    if (checked && word >= words) image_corrupt();
+    uint64_t zeros = ~lt->bits[word] >> (pos % 64);
+    uint32_t degree = 0;
+    while (zeros == 0) {
+        degree += 64 - (word == pos / 64 ? pos % 64 : 0);
+        if (checked && word + 1 >= words) image_corrupt();
+        zeros = ~lt->bits[++word];
+    }
+    degree += __builtin_ctzll(zeros);
+    if (checked && (first == 0 || (uint64_t) first + degree > lt->size)) {
+        image_corrupt();
+    }
+
+    uint32_t i;
+    for (i = 0; i < degree; i++) {
+        uint8_t label = lt->labels[first - 1 + i];
+        if (label == index) return first + i;
+        if (label > index) break;
+    }
+
+    return NO_NODE;
+}
+
+/*
+ * create_radix_trie
+ *
+ * Build the radix representation of trie t, collapsing every chain
+ * of nodes with a single child and no word into one edge label.
+ *
+ * If source is not NULL it receives an array giving for every
+ * radix node the trie node ending its chain.
+ */
+radix_trie *
+create_radix_trie(trie *t, uint32_t **source)
+{
+    radix_trie *rt = (radix_trie *) malloc(sizeof(radix_trie));
+    uint32_t *order = (uint32_t *) malloc(t->size * sizeof(uint32_t));
+    if (rt == NULL || order == NULL) {
+        printf("Error: Failed to allocate memory for Radix Trie.\n");
+        exit(1);
+    }
+
+    /* Neither can outgrow the trie: every label letter stands for a
+       trie node that no radix node keeps. */
+    rt->nodes = (radix_node *) malloc(t->size * sizeof(radix_node));
+    rt->labels = (uint8_t *) malloc(t->size);
+    if (rt->nodes == NULL || rt->labels == NULL) {
+        printf("Error: Failed to allocate memory for Radix Trie.\n");
+        exit(1);
+    }
+
+    /* order[] is the breadth first queue of the trie nodes that end
+       each radix node's chain. */
+    uint32_t head, tail = 0, pool = 0;
+    order[tail++] = TRIE_ROOT;
+    rt->nodes[0].label = 0;
+    rt->nodes[0].label_len = 0;
+    for (head = 0; head < tail; head++) {
+        trie_node *node = &t->nodes[order[head]];
+        radix_node *packed = &rt->nodes[head];
+
+        packed->mask = 0;
+        packed->first = tail;
+        packed->word = node->word;
+
+        int i;
+        for (i = 0; i < ALPHABET_SIZE; i++) {
+            uint32_t child = node->next[i];
+            if (child == NO_NODE) continue;
+
+            packed->mask |= 1u << i;
+            rt->nodes[tail].label = pool;
+
+            /* follow the chain while it neither ends a word nor
+               branches */
+            for (;;) {
+                trie_node *link = &t->nodes[child];
+                int only = -1, count = 0, j;
+
+                if (link->word != NO_WORD) break;
+                for (j = 0; j < ALPHABET_SIZE && count < 2; j++) {
+                    if (link->next[j] != NO_NODE) {
+                        only = j;
+                        count++;
+                    }
+                }
+                if (count != 1) break;
+
+                rt->labels[pool++] = only;
+                child = link->next[only];
+            }
+
+            rt->nodes[tail].label_len = pool - rt->nodes[tail].label;
+            order[tail++] = child;
+        }
+    }
+
+    if (source != NULL) {
+        *source = order;
+    } else {
+        free(order);
+    }
+
+    rt->size = tail;
+    rt->labels_size = pool;
+    rt->nodes = (radix_node *) realloc(rt->nodes, tail * sizeof(radix_node));
+    rt->labels = (uint8_t *) realloc(rt->labels, pool + 1);
+
+    return rt;
+}
+
+/*
+ * delete_radix_trie
+ *
+ * Free the radix trie.
+ */
+void
+delete_radix_trie(radix_trie *rt)
+{
+    free(rt->nodes);
+    free(rt->labels);
+    free(rt);
+}
+
+/*
+ * create_dict
+ *
+ * Read all words from dictionary file and create the searchable
+ * dictionary of the given kind, as a minimal DAWG if minimize is
+ * set, with node summaries for pruning the search if summarize is
+ * set. If inventory is not NULL, only the words it can spell are
+ * kept (see read_words). Unless it is minimized, the trie is built
+ * with up to 'threads' threads.
+ *
+ * Representations other than TRIE_ARRAY are built from a trie that
+ * is freed afterwards, except LOUDS, which is built straight from
+ * the sorted words so loading never needs the memory of a full
+ * trie.
+ */
+dict *
+create_dict(FILE *fp, trie_kind kind, bool minimize, bool summarize,
+            const uint32_t *inventory, int threads)
+{
+    dict *d = (dict *) malloc(sizeof(dict));
+    if (d == NULL) {
+        printf("Error: Failed to allocate memory for Dictionary.\n");
+        exit(1);
+    }
+
+    d->kind = kind;
+    d->words = read_words(fp, inventory);
+    d->ordered = false;
+    d->trie = NULL;
+    d->sparse = NULL;
+    d->da = NULL;
+    d->louds = NULL;
+    d->radix = NULL;
+    d->summary = NULL;
+    d->image = NULL;
+    d->image_size = 0;
+
+    if (kind == TRIE_LOUDS) {
+        sort_words(d->words);
+        d->louds = create_louds_trie(d->words,
+                                     summarize ? &d->summary : NULL);
+        return d;
+    }
+
+    trie *t = create_trie();
+    if (minimize) {
+        sort_words(d->words);
+        fill_dawg(t, d->words);
+        d->kind = TRIE_DAWG;
+        d->ordered = true;
+    } else {
+        d->ordered = fill_trie_parallel(t, d->words, threads);
+        if (kind == TRIE_ARRAY) freeze_trie(t);
+    }
+
+    node_summary *summary = summarize ? summarize_trie(t) : NULL;
+    uint32_t *source = NULL;
+    uint32_t **sourcep = summarize ? &source : NULL;
+
+    switch (kind) {
+    case TRIE_SPARSE:
+        d->sparse = create_sparse_trie(t, sourcep);
+        break;
+    case TRIE_DOUBLE_ARRAY:
+        d->da = create_double_array(t, sourcep);
+        break;
+    case TRIE_RADIX:
+        d->radix = create_radix_trie(t, sourcep);
+        break;
+    default:
+        d->trie = t;
+        d->summary = summary;
+        return d;
+    }
+
+    if (summarize) {
+        uint32_t size = d->sparse ? d->sparse->size :
+                        d->da ? d->da->size : d->radix->size;
+        d->summary = remap_summary(summary, source, size);
+        free(summary);
+        free(source);
+    }
+    delete_trie(t);
+
+    return d;
+}
+
+/*
+ * delete_dict
+ *
+ * Free the dictionary and the trie it holds.
+ */
+void
+delete_dict(dict *d)
+{
+    if (d->image != NULL) {
+        /* only the structs are allocated; the arrays are mapped */
+        free(d->trie);
+        free(d->sparse);
+        free(d->da);
+        free(d->louds);
+        free(d->radix);
+        free(d->words);
+        munmap(d->image, d->image_size);
+        free(d);
+        return;
+    }
+
+    if (d->trie) delete_trie(d->trie);
+    if (d->sparse) delete_sparse_trie(d->sparse);
+    if (d->da) delete_double_array(d->da);
+    if (d->louds) delete_louds_trie(d->louds);
+    if (d->radix) delete_radix_trie(d->radix);
+    free(d->summary);
+    delete_words(d->words);
+    free(d);
+}
+
+/*
+ * image_index
+ *
+ * Returns index, after checking that it is below limit if d was
+ * mapped from an image. The indices in a built dictionary are
+ * right by construction and go unchecked.
+ */
+static inline uint32_t
+image_index(const dict *d, uint64_t index, uint64_t limit)
+{
+    if (d->image != NULL && index >= limit) image_corrupt();
+
+    return index;
+}
+
+/*
+ * dict_child
+ *
+ * Returns the child of node for letter index, or NO_NODE.
+ *
+ * *aux is search state some representations keep next to the node,
+ * 0 at the root; the others ignore it.
+ *
+ * In a DAWG it is the number of words sorting before the prefix
+ * leading to node. It is advanced past the words ending at node and
+ * those continuing with a smaller letter, so that at an end node it
+ * is the word's id.
+ *
+ * In a radix trie it is the number of letters of node's edge label
+ * matched so far. Until the whole label is matched, the step stays
+ * on node and only compares the next label letter.
+ */
+static inline uint32_t
+dict_child(const dict *d, uint32_t node, int index, uint32_t *aux)
+{
+    switch (d->kind) {
+    case TRIE_DAWG: {
+        const trie_node *parent = &d->trie->nodes[node];
+        uint32_t next = image_index(d, parent->next[index], d->trie->size);
+        if (next != NO_NODE) {
+            uint32_t before = parent->word != NO_WORD;
+            int i;
+            for (i = 0; i < index; i++) {
+                uint32_t sibling = image_index(d, parent->next[i],
+                                               d->trie->size);
+                if (sibling != NO_NODE) before += d->trie->counts[sibling];
+            }
+            *aux += before;
+        }
+        return next;
+    }
+    case TRIE_SPARSE: {
+        uint32_t mask = d->sparse->nodes[node].mask;
+        uint32_t bit = 1u << index;
+        if (!(mask & bit)) return NO_NODE;
+        return image_index(d, (uint64_t) d->sparse->nodes[node].first +
+                              __builtin_popcount(mask & (bit - 1)),
+                           d->sparse->size);
+    }
+    case TRIE_DOUBLE_ARRAY: {
+        uint32_t next = image_index(d, (uint64_t) (d->da->base[node] &
+                                                   ~DA_END) + index,
+                                    d->da->size);
+        return d->da->check[next] == node ? next : NO_NODE;
+    }
+    case TRIE_LOUDS:
+        return louds_child(d->louds, node, index, d->image != NULL);
+    case TRIE_RADIX: {
+        const radix_node *at = &d->radix->nodes[node];
+        if (*aux < at->label_len) {
+            uint32_t label = image_index(d, (uint64_t) at->label + *aux,
+                                         d->radix->labels_size);
+            if (d->radix->labels[label] != index) return NO_NODE;
+            (*aux)++;
+            return node;
+        }
+
+        uint32_t bit = 1u << index;
+        if (!(at->mask & bit)) return NO_NODE;
+        *aux = 0;
+        return image_index(d, (uint64_t) at->first +
+                              __builtin_popcount(at->mask & (bit - 1)),
+                           d->radix->size);
+    }
+    default:
+        return image_index(d, d->trie->nodes[node].next[index],
+                           d->trie->size);
+    }
+}
+
+/*
+ * dict_word
+ *
+ * Returns the id of the word node ends, or NO_WORD. aux is the
+ * value dict_child left for node.
+ */
+static inline uint32_t
+dict_word(const dict *d, uint32_t node, uint32_t aux)
+{
+    uint32_t word;
+    switch (d->kind) {
+    case TRIE_DAWG:
+        word = d->trie->nodes[node].word != NO_WORD ? aux : NO_WORD;
+        break;
+    case TRIE_SPARSE:
+        word = d->sparse->nodes[node].word;
+        break;
+    case TRIE_DOUBLE_ARRAY:
+        word = d->da->base[node] & DA_END ? d->da->word[node] : NO_WORD;
+        break;
+    case TRIE_LOUDS: {
+        uint64_t bits = d->louds->is_end[node / 64];
+        uint64_t bit = (uint64_t) 1 << (node % 64);
+        if (!(bits & bit)) return NO_WORD;
+        word = d->louds->end_rank[node / 64] +
+               __builtin_popcountll(bits & (bit - 1));
+        break;
+    }
+    case TRIE_RADIX:
+        /* partway along a label is never the end of a word */
+        word = aux == d->radix->nodes[node].label_len ?
+               d->radix->nodes[node].word : NO_WORD;
+        break;
+    default:
+        word = d->trie->nodes[node].word;
+    }
+
+    return word == NO_WORD ? NO_WORD : image_index(d, word, d->words->count);
+}
+
+/*
+ * dict_summary
+ *
+ * Returns the summary of node, or NULL if there is none for the
+ * position aux gives.
+ */
+static inline const node_summary *
+dict_summary(const dict *d, uint32_t node, uint32_t aux)
+{
+    if (d->summary == NULL) return NULL;
+
+    /* partway along a radix label the node's summary does not apply */
+    if (d->kind == TRIE_RADIX && aux != d->radix->nodes[node].label_len) {
+        return NULL;
+    }
+
+    return &d->summary[node];
+}
+
+/* Starting value of an FNV-1a hash. */
+#define FNV_OFFSET 14695981039346656037ULL
+
+/*
+ * fnv_hash
+ *
+ * Returns FNV-1a hash 'hash' continued over size bytes of data.
+ */
+uint64_t
+fnv_hash(uint64_t hash, const void *data, size_t size)
+{
+    const unsigned char *bytes = (const unsigned char *) data;
+    size_t i;
+    for (i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+/*
+ * image_checksum
+ *
+ * Returns the checksum of image header h.
+ */
+uint64_t
+image_checksum(const image_header *h)
+{
+    image_header copy = *h;
+    copy.checksum = 0;
+
+    return fnv_hash(FNV_OFFSET, &copy, sizeof(copy));
+}
+
+/*
+ * image_put
+ *
+ * Append size bytes of data to the image being written. A failed
+ * write is only noted in w->failed, for write_dict to report.
+ */
+void
+image_put(image_writer *w, const void *data, size_t size)
+{
+    if (size > 0 && !w->failed && fwrite(data, 1, size, w->fp) != size) {
+        w->failed = true;
+    }
+    w->offset += size;
+    w->hash = fnv_hash(w->hash, data, size);
+}
+
+/*
+ * image_begin
+ *
+ * Start section number 'section' of the image at the next
+ * IMAGE_ALIGN boundary.
+ */
+void
+image_begin(image_writer *w, int section)
+{
+    static const char zeros[IMAGE_ALIGN];
+    image_put(w, zeros, (IMAGE_ALIGN - w->offset % IMAGE_ALIGN) % IMAGE_ALIGN);
+    w->header.sections[section].offset = w->offset;
+    w->hash = FNV_OFFSET;
+}
+
+/*
+ * image_end
+ *
+ * Finish section number 'section' with what was put since it began.
+ */
+void
+image_end(image_writer *w, int section)
+{
+    image_section *at = &w->header.sections[section];
+    at->size = w->offset - at->offset;
+    at->checksum = w->hash;
+}
+
+/*
+ * image_array
+ *
+ * Write count elements of elem_size bytes at data as section
+ * number 'section' of the image.
+ */
+void
+image_array(image_writer *w, int section, const void *data,
+            size_t elem_size, size_t count)
+{
+    image_begin(w, section);
+    image_put(w, data, elem_size * count);
+    image_end(w, section);
+}
+
+/*
+ * write_dict
+ *
+ * Write dictionary d as an image to fp. The words are packed into
+ * a fresh pool in word id order, so offsets[] is increasing.
+ * Returns false, after printing why, if the image could not be
+ * written; the caller is left to clean up the file.
+ */
+bool
+write_dict(const dict *d, FILE *fp)
+{
+    image_writer w;
+    memset(&w, 0, sizeof(w));
+    w.fp = fp;
+
+    /* the header is written again once the section table is known */
+    image_put(&w, &w.header, sizeof(w.header));
+
+    const word_list *list = d->words;
+    uint32_t *offsets = (uint32_t *) malloc((list->count + 1) *
+                                            sizeof(uint32_t));
+    if (offsets == NULL) {
+        printf("Error: Failed to allocate memory for Dictionary.\n");
+        return false;
+    }
+
+    image_begin(&w, SECTION_POOL);
+    uint32_t i;
+    for (i = 0; i < list->count; i++) {
+        const char *word = word_text(list, i);
+        uint64_t offset = w.offset - w.header.sections[SECTION_POOL].offset;
+        if (offset > UINT32_MAX) {
+            printf("Error: Dictionary too large for an image.\n");
+            free(offsets);
+            return false;
+        }
+        offsets[i] = offset;
+        image_put(&w, word, strlen(word) + 1);
+    }
+    image_end(&w, SECTION_POOL);
+    image_array(&w, SECTION_OFFSETS, offsets, sizeof(uint32_t), list->count);
+    free(offsets);
+
+    uint32_t nodes = 0;
+    switch (d->kind) {
+    case TRIE_SPARSE:
+        nodes = d->sparse->size;
+        image_array(&w, SECTION_NODES, d->sparse->nodes,
+                    sizeof(sparse_node), nodes);
+        break;
+    case TRIE_DOUBLE_ARRAY:
+        nodes = d->da->size;
+        image_array(&w, SECTION_BASE, d->da->base, sizeof(uint32_t), nodes);
+        image_array(&w, SECTION_CHECK, d->da->check, sizeof(uint32_t), nodes);
+        image_array(&w, SECTION_WORD, d->da->word, sizeof(uint32_t), nodes);
+        break;
+    case TRIE_LOUDS:
+        nodes = d->louds->size;
+        image_array(&w, SECTION_BITS, d->louds->bits,
+                    sizeof(uint64_t), nodes / 32 + 1);
+        image_array(&w, SECTION_IS_END, d->louds->is_end,
+                    sizeof(uint64_t), nodes / 64 + 1);
+        image_array(&w, SECTION_END_RANK, d->louds->end_rank,
+                    sizeof(uint32_t), nodes / 64 + 1);
+        image_array(&w, SECTION_SELECT_HINT, d->louds->select_hint,
+                    sizeof(uint32_t), nodes / LOUDS_SELECT_STEP + 1);
+        image_array(&w, SECTION_LABELS, d->louds->labels,
+                    sizeof(uint8_t), nodes);
+        break;
+    case TRIE_RADIX:
+        nodes = d->radix->size;
+        image_array(&w, SECTION_NODES, d->radix->nodes,
+                    sizeof(radix_node), nodes);
+        image_array(&w, SECTION_LABELS, d->radix->labels,
+                    sizeof(uint8_t), d->radix->labels_size);
+        break;
+    default:
+        nodes = d->trie->size;
+        image_array(&w, SECTION_NODES, d->trie->nodes,
+                    sizeof(trie_node), nodes);
+        if (d->trie->counts != NULL) {
+            image_array(&w, SECTION_COUNTS, d->trie->counts,
+                        sizeof(uint32_t), nodes);
+        }
+    }
+
+    if (d->summary != NULL) {
+        image_array(&w, SECTION_SUMMARY, d->summary,
+                    sizeof(node_summary), nodes);
+    }
+
+    memcpy(w.header.magic, IMAGE_MAGIC, IMAGE_MAGIC_SIZE);
+    w.header.version = IMAGE_VERSION;
+    w.header.header_size = sizeof(w.header);
+    strncpy(w.header.alphabet, IMAGE_ALPHABET, IMAGE_ALPHABET_SIZE);
+    w.header.file_size = w.offset;
+    w.header.kind = d->kind;
+    w.header.ordered = d->ordered;
+    w.header.word_count = list->count;
+    w.header.node_count = nodes;
+    w.header.checksum = image_checksum(&w.header);
+
+    if (w.failed || fseek(fp, 0, SEEK_SET) != 0 ||
+        fwrite(&w.header, sizeof(w.header), 1, fp) != 1) {
+        printf("Error: Failed to write dictionary image.\n");
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * save_dict
+ *
+ * Write dictionary d as an image to the file called name. The
+ * image is written to name.tmp and renamed over name only once it
+ * is complete and on disk, so an interrupted compile never leaves
+ * a partial image behind, and processes still mapping the old
+ * image keep their copy.
+ */
+void
+save_dict(const dict *d, const char *name)
+{
+    size_t length = strlen(name);
+    char *temp = (char *) malloc(length + sizeof(".tmp"));
+    if (temp == NULL) {
+        printf("Error: Failed to allocate memory for Dictionary.\n");
+        exit(1);
+    }
+    memcpy(temp, name, length);
+    memcpy(temp + length, ".tmp", sizeof(".tmp"));
+
+    FILE *fp = fopen(temp, "wb");
+    if (fp == NULL) {
+        printf("Error: Failed to create %s.\n", temp);
+        exit(1);
+    }
+    if (!write_dict(d, fp)) {
+        fclose(fp);
+        remove(temp);
+        exit(1);
+    }
+
+    if (fflush(fp) != 0 || fsync(fileno(fp)) != 0 || fclose(fp) != 0 ||
+        rename(temp, name) != 0) {
+        printf("Error: Failed to write dictionary image.\n");
+        remove(temp);
+        exit(1);
     }
 
-    /* Mark the last node as leaf */
-    parent->is_end = true;
+    free(temp);
 }
 
 /*
- * delete_trie
+ * is_image
  *
- * Free the entire trie.
+ * Returns true if the file fp is a dictionary image. Leaves fp
+ * at the start of the file. Only regular files can be mapped, so
+ * pipes are never read from here.
  */
-void
-delete_trie(trie_node *root)
+bool
+is_image(FILE *fp)
 {
-    if (root == NULL) return;
+    struct stat st;
+    if (fstat(fileno(fp), &st) != 0 || !S_ISREG(st.st_mode)) return false;
 
-    int i;
-    for (i = 0; i < ALPHABET_SIZE; i++) {
-        delete_trie(root->next[i]);
-    }
+    char magic[IMAGE_MAGIC_SIZE];
+    bool image = fread(magic, 1, IMAGE_MAGIC_SIZE, fp) == IMAGE_MAGIC_SIZE &&
+                 memcmp(magic, IMAGE_MAGIC, IMAGE_MAGIC_SIZE) == 0;
+    rewind(fp);
 
-    free(root);
+    return image;
 }
 
 /*
- * fill_trie
+ * image_section_data
  *
- * Read all words from dictionary file line by line and
- * add the words to trie.
+ * Returns the start of section number 'section' of the image
+ * mapped at base, after checking that it holds exactly count
+ * elements of elem_size bytes. An empty section gives NULL.
  */
-void
-fill_trie(trie_node *root, FILE *fp)
+void *
+image_section_data(const dict *d, const image_header *header, int section,
+                   size_t elem_size, uint64_t count)
 {
-    char word[WORD_SIZE];
-
-    while (fgets(word, sizeof(word), fp) != NULL) {
-        /* fgets might add a newline at the end of the string read. */
-        word[strlen(word) - 1] = '\0';
-        insert_trie(root, word);
+    const image_section *at = &header->sections[section];
+    if (at->size != elem_size * count || at->offset % IMAGE_ALIGN != 0 ||
+        at->offset > d->image_size || at->size > d->image_size - at->offset) {
+        image_corrupt();
     }
+
+    return count ? (char *) d->image + at->offset : NULL;
 }
 
 /*
- * hcomb_store
+ * verify_image
  *
- * Helper function to help store the characters in
- * the honeycomb array columns.
+ * Check every section of the image mapped for d against its
+ * checksum. This reads the whole image.
  */
 void
-hcomb_store(honeycomb *hc, char **layers, int num_layers, bool right)
+verify_image(const dict *d)
 {
-    int i, j;
-
-    for (i = num_layers - 1; i >= 0; i--) {
-        int column_len = 2 * num_layers - i;
-        char *column = (char *) malloc(column_len + 1); // + 1 for '\0'
-        column[column_len] = '\0';
-        /* copy contiguous segment of layer i in ith column from center */
-        strncpy(column + num_layers - i - 1, layers[i] + i, i + 2);
-
-        /* add characters to column that are part of adjacent layers */
-        for (j = num_layers - 1; j > i; j--) {
-            /* character on lower end of ith column from center */
-            strncpy(column + num_layers - j - 1, layers[j] + i, 1);
-            /* character on upper end of ith column from center */
-            strncpy(column + num_layers - i + j, layers[j] - i + 3 * j + 1, 1);
-        }
-
-        /* 'half' multiplier places column in the correct half of
-            hc's internal columns array */
-        if (right) {
-            hc->columns[num_layers + i + 1] = column;
-        } else {
-            hc->columns[num_layers - i - 1] = column;
+    const image_header *header = (const image_header *) d->image;
+    int i;
+    for (i = 0; i < IMAGE_SECTIONS; i++) {
+        const image_section *at = &header->sections[i];
+        if (at->size == 0) continue;
+
+        /* the section must lie in the image before it is hashed */
+        image_section_data(d, header, i, 1, at->size);
+        if (fnv_hash(FNV_OFFSET, (char *) d->image + at->offset,
+                     at->size) != at->checksum) {
+            image_corrupt();
         }
     }
 }
 
 /*
- * fill_honeycomb
+ * map_dict
  *
- * Fill the honeycomb to store word search characters.
+ * Map the dictionary image in file fp read only and return the
+ * dictionary it holds. The arrays are used in place, so loading
+ * costs the same whatever the dictionary's size, and processes
+ * mapping the same image share its pages.
+ *
+ * Unless verify is set, which checks every section against its
+ * checksum first, only the header and the last byte of the word
+ * pool are read here. Searches jump around the node arrays, so
+ * read ahead is turned off and just the pages they touch are
+ * faulted in.
  */
-void
-fill_honeycomb(honeycomb *hc, FILE *fp, int layers)
+dict *
+map_dict(FILE *fp, bool verify)
 {
-    /* Allocate space for '\0' */
-    char *center = (char *) malloc(2 * layers);
-    fscanf(fp, " %c", center + layers - 1);
-    center[2 * layers - 1] = '\0';
+    struct stat st;
+    if (fstat(fileno(fp), &st) != 0 ||
+        (uint64_t) st.st_size < sizeof(image_header)) {
+        image_corrupt();
+    }
 
-    if (layers > 1) {
-        char *rightlayers[layers - 1];
-        char *leftlayers[layers - 1];
+    void *image = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED,
+                       fileno(fp), 0);
+    if (image == MAP_FAILED) {
+        printf("Error: Failed to map dictionary image.\n");
+        exit(1);
+    }
 
-        int i, j, k;
-        for (i = 1; i < layers; i++) {
-            int halflayerlen = 2 + (i - 1) * 3;
-            char *right = (char *) malloc(halflayerlen + 1);
-            char *left = (char *) malloc(halflayerlen + 1);
+    dict *d = (dict *) calloc(1, sizeof(dict));
+    word_list *list = (word_list *) calloc(1, sizeof(word_list));
+    if (d == NULL || list == NULL) {
+        printf("Error: Failed to allocate memory for Dictionary.\n");
+        exit(1);
+    }
 
-            /* ead first char in layer string to upper center column */
-            fscanf(fp, " %c", center + layers - 1 + i);
+    d->image = image;
+    d->image_size = st.st_size;
+    madvise(image, st.st_size, MADV_RANDOM);
 
-            /* read right side of layer and add to right layer
-               string in REVERSE order */
-            for (j = halflayerlen - 1; j >= 0; j--) {
-                fscanf(fp, " %c", &(right[j]));
-            }
+    const image_header *header = (const image_header *) image;
+    if (header->version != IMAGE_VERSION ||
+        header->header_size != sizeof(image_header)) {
+        printf("Error: Unsupported dictionary image version %u.\n",
+               header->version);
+        exit(1);
+    }
+    if (header->checksum != image_checksum(header) ||
+        header->file_size != (uint64_t) st.st_size ||
+        header->kind > TRIE_RADIX || header->node_count == 0) {
+        image_corrupt();
+    }
+    if (strncmp(header->alphabet, IMAGE_ALPHABET,
+                IMAGE_ALPHABET_SIZE) != 0) {
+        printf("Error: Dictionary image has a different alphabet.\n");
+        exit(1);
+    }
+    if (verify) verify_image(d);
+    d->kind = header->kind;
+    d->ordered = header->ordered;
+    d->words = list;
+
+    uint32_t nodes = header->node_count;
+    list->count = header->word_count;
+    list->pool_size = header->sections[SECTION_POOL].size;
+    list->pool = image_section_data(d, header, SECTION_POOL, 1,
+                                    list->pool_size);
+
+    /* every word, so the last, ends in a NUL within the pool */
+    if (list->pool_size != 0 && list->pool[list->pool_size - 1] != '\0') {
+        image_corrupt();
+    }
+    list->offsets = image_section_data(d, header, SECTION_OFFSETS,
+                                       sizeof(uint32_t), list->count);
+
+    switch (d->kind) {
+    case TRIE_SPARSE:
+        d->sparse = (sparse_trie *) malloc(sizeof(sparse_trie));
+        if (d->sparse == NULL) break;
+        d->sparse->size = nodes;
+        d->sparse->nodes = image_section_data(d, header, SECTION_NODES,
+                                              sizeof(sparse_node), nodes);
+        break;
+    case TRIE_DOUBLE_ARRAY:
+        d->da = (double_array *) malloc(sizeof(double_array));
+        if (d->da == NULL) break;
+        d->da->size = nodes;
+        d->da->base = image_section_data(d, header, SECTION_BASE,
+                                         sizeof(uint32_t), nodes);
+        d->da->check = image_section_data(d, header, SECTION_CHECK,
+                                          sizeof(uint32_t), nodes);
+        d->da->word = image_section_data(d, header, SECTION_WORD,
+                                         sizeof(uint32_t), nodes);
+        break;
+    case TRIE_LOUDS:
+        d->louds = (louds_trie *) malloc(sizeof(louds_trie));
+        if (d->louds == NULL) break;
+        d->louds->size = nodes;
+        d->louds->bits = image_section_data(d, header, SECTION_BITS,
+                                            sizeof(uint64_t), nodes / 32 + 1);
+        d->louds->is_end = image_section_data(d, header, SECTION_IS_END,
+                                              sizeof(uint64_t), nodes / 64 + 1);
+        d->louds->end_rank = image_section_data(d, header, SECTION_END_RANK,
+                                                sizeof(uint32_t),
+                                                nodes / 64 + 1);
+        d->louds->select_hint = image_section_data(d, header,
+                                                   SECTION_SELECT_HINT,
+                                                   sizeof(uint32_t),
+                                                   nodes / LOUDS_SELECT_STEP + 1);
+        d->louds->labels = image_section_data(d, header, SECTION_LABELS,
+                                              sizeof(uint8_t), nodes);
+        break;
+    case TRIE_RADIX:
+        d->radix = (radix_trie *) malloc(sizeof(radix_trie));
+        if (d->radix == NULL) break;
+        d->radix->size = nodes;
+        d->radix->labels_size = header->sections[SECTION_LABELS].size;
+        d->radix->nodes = image_section_data(d, header, SECTION_NODES,
+                                             sizeof(radix_node), nodes);
+        d->radix->labels = image_section_data(d, header, SECTION_LABELS,
+                                              sizeof(uint8_t),
+                                              d->radix->labels_size);
+        break;
+    default:
+        d->trie = (trie *) malloc(sizeof(trie));
+        if (d->trie == NULL) break;
+        d->trie->size = nodes;
+        d->trie->capacity = nodes;
+        d->trie->nodes = image_section_data(d, header, SECTION_NODES,
+                                            sizeof(trie_node), nodes);
+        d->trie->counts = d->kind == TRIE_DAWG ?
+                          image_section_data(d, header, SECTION_COUNTS,
+                                             sizeof(uint32_t), nodes) : NULL;
+    }
+    if (!d->trie && !d->sparse && !d->da && !d->louds && !d->radix) {
+        printf("Error: Failed to allocate memory for Dictionary.\n");
+        exit(1);
+    }
 
-            right[halflayerlen] = '\0';
-            rightlayers[i - 1] = right;
-            fscanf(fp, " %c", center + layers - 1 - i);
+    if (header->sections[SECTION_SUMMARY].size != 0) {
+        d->summary = image_section_data(d, header, SECTION_SUMMARY,
+                                        sizeof(node_summary), nodes);
+    }
 
-            /* read left side of layer and add to left layer
-               string in SAME order */
-            for (k = 0; k < halflayerlen; k++) {
-                fscanf(fp, " %c", left + k);
-            }
+    return d;
+}
 
-            left[halflayerlen] = '\0';
-            leftlayers[i - 1] = left;
-        }
+/*
+ * hex_column_start
+ *
+ * Returns the number of cells in the columns left of column q of
+ * a honeycomb of the given radius. Column k holds
+ * 2 * radius + 1 - |k| cells. The terms of the sum can exceed an
+ * int even when the result does not, so it is done in 64 bits.
+ */
+int64_t
+hex_column_start(int radius, int q)
+{
+    int64_t width = 2 * (int64_t) radius + 1;
 
-        /* pass layers - 1 because center layer is not stored;
-           only layers 1 through layers - 1 */
-        hcomb_store(hc, leftlayers, layers - 1, false);
-        hcomb_store(hc, rightlayers, layers - 1, true);
+    if (q <= 0) {
+        int64_t n = (int64_t) q + radius;
+        return n * width + n * (q - 1 - (int64_t) radius) / 2;
+    }
 
-        for (i = 0; i < layers - 1; i++) {
-            free(rightlayers[i]);
-            free(leftlayers[i]);
-        }
+    return radius * width - radius * ((int64_t) radius + 1) / 2 +
+           q * width - q * ((int64_t) q - 1) / 2;
+}
+
+/*
+ * hex_cell
+ *
+ * Returns the cell at axial coordinates (q, r) of the honeycomb,
+ * or -1 if there is none.
+ */
+static inline int
+hex_cell(const honeycomb *hc, int q, int r)
+{
+    int radius = hc->radius;
+    if (q < -radius || q > radius || r < -radius || r > radius ||
+        q + r < -radius || q + r > radius) {
+        return -1;
     }
 
-    hc->columns[layers - 1] = center;
+    return hc->column_base[q + radius] + r;
+}
+
+/*
+ * hex_neighbor
+ *
+ * Returns the cell a step hex_directions[i] from (q, r), which must
+ * be allowed by the directions of the cell at (q, r).
+ */
+static inline int
+hex_neighbor(const honeycomb *hc, int q, int r, int i)
+{
+    return hc->column_base[q + hex_directions[i][0] + hc->radius] +
+           r + hex_directions[i][1];
 }
 
 /*
  * create_honeycomb
  *
  * Create the Honeycomb datastructure to store word search characters.
- * Allocate space for arrays representing honeycomb's columns.
+ * Allocate space for the cells of all layers.
  */
 honeycomb *
 create_honeycomb(int layers)
@@ -239,14 +3202,46 @@ create_honeycomb(int layers)
         exit(1);
     }
 
-    hc->number_columns = 2 * layers - 1;
-    hc->columns = (char **) calloc(hc->number_columns, sizeof(char *));
-    if (hc->columns == NULL) {
+    hc->radius = layers - 1;
+    int64_t size = hex_column_start(hc->radius, hc->radius + 1);
+    if (size > INT_MAX) {
+        printf("Error: Honeycomb has too many layers.\n");
+        exit(1);
+    }
+    hc->size = size;
+    hc->cells = (char *) malloc(hc->size);
+    hc->directions = (uint8_t *) malloc(hc->size);
+    hc->column_base = (int *) malloc((2 * hc->radius + 1) * sizeof(int));
+    if (hc->cells == NULL || hc->directions == NULL ||
+        hc->column_base == NULL) {
         printf("Error: Failed to allocate memory for Honeycomb.\n");
-        free(hc);
         exit(1);
     }
 
+    /* column q starts at the larger of -radius and -radius - q */
+    int q;
+    for (q = -hc->radius; q <= hc->radius; q++) {
+        int top = q < 0 ? -hc->radius - q : -hc->radius;
+        hc->column_base[q + hc->radius] = hex_column_start(hc->radius, q) - top;
+    }
+
+    for (q = -hc->radius; q <= hc->radius; q++) {
+        int top = q < 0 ? -hc->radius - q : -hc->radius;
+        int bottom = q > 0 ? hc->radius - q : hc->radius;
+        int r;
+        for (r = top; r <= bottom; r++) {
+            uint8_t mask = 0;
+            int i;
+            for (i = 0; i < HEX_NEIGHBORS; i++) {
+                if (hex_cell(hc, q + hex_directions[i][0],
+                             r + hex_directions[i][1]) >= 0) {
+                    mask |= 1 << i;
+                }
+            }
+            hc->directions[hex_cell(hc, q, r)] = mask;
+        }
+    }
+
     return hc;
 }
 
@@ -258,13 +3253,33 @@ create_honeycomb(int layers)
 void
 delete_honeycomb(honeycomb *hc)
 {
+    free(hc->cells);
+    free(hc->directions);
+    free(hc->column_base);
+    free(hc);
+}
+
+/*
+ * count_letters
+ *
+ * Raise inventory[i] to the number of cells holding letter i in
+ * the honeycomb, if it has more than counted so far. Counting
+ * several honeycombs this way gives the letters any of them can
+ * spell a word with.
+ */
+void
+count_letters(honeycomb *hc, uint32_t *inventory)
+{
+    uint32_t counts[ALPHABET_SIZE] = {0};
+
     int i;
-    for (i = 0; i < hc->number_columns; i++) {
-        free(hc->columns[i]);
+    for (i = 0; i < hc->size; i++) {
+        counts[CHAR_TO_INDEX(hc->cells[i])]++;
     }
 
-    free(hc->columns);
-    free(hc);
+    for (i = 0; i < ALPHABET_SIZE; i++) {
+        if (counts[i] > inventory[i]) inventory[i] = counts[i];
+    }
 }
 
 /*
@@ -286,6 +3301,7 @@ create_store()
     }
 
     store->size = 0;
+    store->capacity = 0;
     store->words = NULL;
 
     return store;
@@ -299,62 +3315,165 @@ create_store()
 void
 delete_store(word_store *store)
 {
-     int i;
-    for (i = 0; i < store->size; i++) {
-        free(store->words[i]);
-    }
-
     free(store->words);
     free(store);
 }
 
+/*
+ * create_match_set
+ *
+ * Create the Match Set for searches of dictionary d. Every search
+ * running at the same time needs its own.
+ */
+match_set *
+create_match_set(const dict *d)
+{
+    match_set *matches = (match_set *) malloc(sizeof(match_set));
+    if (matches == NULL) {
+        printf("Error: Failed to allocate memory for Match Set.\n");
+        exit(1);
+    }
+
+    matches->size = d->words->count;
+    matches->seen = (uint32_t *) calloc(matches->size, sizeof(uint32_t));
+    if (matches->seen == NULL) {
+        printf("Error: Failed to allocate memory for Match Set.\n");
+        exit(1);
+    }
+    matches->generation = 0;
+
+    return matches;
+}
+
+/*
+ * delete_match_set
+ *
+ * Delete the Match Set.
+ */
+void
+delete_match_set(match_set *matches)
+{
+    free(matches->seen);
+    free(matches);
+}
+
+/*
+ * add_word
+ *
+ * Add a word id to the Word Store, growing it as needed.
+ */
+void
+add_word(word_store *store, uint32_t word)
+{
+    if (store->size == store->capacity) {
+        store->capacity = store->capacity ? 2 * store->capacity : 64;
+        store->words = (uint32_t *) realloc(store->words,
+                                            store->capacity * sizeof(uint32_t));
+        if (store->words == NULL) {
+            printf("Error: Failed to allocate memory for Word Store.\n");
+            exit(1);
+        }
+    }
+
+    store->words[store->size++] = word;
+}
+
+/*
+ * search_step
+ *
+ * Report the word ending at node, reached with aux, if there is
+ * one not reported yet. Returns false if the search should go no
+ * further from node, as no word continues from it, or every one
+ * needs a letter the honeycomb lacks or more cells than are left
+ * after the depth + 1 on the path.
+ */
+static inline bool
+search_step(search *sc, uint32_t node, uint32_t aux, int depth)
+{
+    /* Report each word once per search. */
+    match_set *matches = sc->matches;
+    uint32_t word = dict_word(sc->d, node, aux);
+    if (word != NO_WORD && matches->seen[word] != matches->generation) {
+        matches->seen[word] = matches->generation;
+        add_word(sc->store, word);
+    }
+
+    const node_summary *summary = dict_summary(sc->d, node, aux);
+    return summary == NULL ||
+           !(summary->max_len == 0 ||
+             (summary->need & ~sc->letters) != 0 ||
+             (summary->has & sc->letters) == 0 ||
+             summary->min_len > sc->cells - depth - 1);
+}
+
+/*
+ * find_words_small
+ *
+ * find_words_trie for honeycombs of at most SMALL_HONEYCOMB cells,
+ * which keeps the cells on the path in the bits of 'path' rather
+ * than in memory.
+ */
+void
+find_words_small(search *sc, uint32_t node, uint32_t aux, int depth,
+                 int cell, int q, int r, uint64_t path)
+{
+    const honeycomb *hc = sc->hc;
+
+    uint32_t next = dict_child(sc->d, node, CHAR_TO_INDEX(hc->cells[cell]),
+                               &aux);
+    if (next == NO_NODE || !search_step(sc, next, aux, depth)) return;
+
+    path |= (uint64_t) 1 << cell;
+    uint8_t directions = hc->directions[cell];
+    int i;
+    for (i = 0; i < HEX_NEIGHBORS; i++) {
+        if (!(directions >> i & 1)) continue;
+
+        int near = hex_neighbor(hc, q, r, i);
+        if (!(path >> near & 1)) {
+            find_words_small(sc, next, aux, depth + 1, near,
+                             q + hex_directions[i][0],
+                             r + hex_directions[i][1], path);
+        }
+    }
+}
+
 /*
  * find_words_trie
  *
  * Helper function to recursively find words with a prefix
- * in the trie.
+ * in the trie. The prefix leading to node, depth letters long,
+ * continues with the letter in cell, at (q, r), which is not on
+ * the path yet; aux is what dict_child left for node.
  */
 void
-find_words_trie(honeycomb *hc, trie_node *node, word_store* store,
-                char *word, int column, int label)
+find_words_trie(search *sc, uint32_t node, uint32_t aux, int depth,
+                int cell, int q, int r)
 {
-    /* Basic sanity */
-    if ((column < 0 || label < 0 || column >= hc->number_columns ||
-        label >= strlen(hc->columns[column]) || hc->columns[column][label] == '-')
-        && strlen(word) != 0) {
-        return;
-    } else {
-        /* Add the current character to the end of the prefix */
-        strncat(word, hc->columns[column] + label, 1);
-        int index = CHAR_TO_INDEX(hc->columns[column][label]);
-        trie_node* next_node = node->next[index];
-        if (next_node) {
-            if (next_node->is_end) {
-                store->words = realloc(store->words,
-                                       ++(store->size) * sizeof(char *));
-                store->words[store->size-1] = strdup(word);
-                /* Remove the end marker for this key to avoid
-                   duplicate detection */
-                next_node->is_end = false;
-            }
+    const honeycomb *hc = sc->hc;
 
-            /* avoid revisting */
-            char save = hc->columns[column][label];
-            hc->columns[column][label] = '-';
-            int i, j;
-            for (i = -1; i <= 1; i++) {
-                for (j = -1; j <= 1; j++) {
-                    if (!(column + i == column && label + j == label)) {
-                        find_words_trie(hc, next_node, store, word,
-                                        column + i, label + j);
-                    }
-                }
-            }
-            hc->columns[column][label] = save;
-        }
+    uint32_t next = dict_child(sc->d, node, CHAR_TO_INDEX(hc->cells[cell]),
+                               &aux);
+    if (next == NO_NODE || !search_step(sc, next, aux, depth)) return;
 
-        word[strlen(word) - 1] = '\0';
+    /* avoid revisting */
+    uint64_t bit = (uint64_t) 1 << (cell % 64);
+    sc->path[cell / 64] |= bit;
+
+    uint8_t directions = hc->directions[cell];
+    int i;
+    for (i = 0; i < HEX_NEIGHBORS; i++) {
+        if (!(directions >> i & 1)) continue;
+
+        int near = hex_neighbor(hc, q, r, i);
+        if (!(sc->path[near / 64] >> (near % 64) & 1)) {
+            find_words_trie(sc, next, aux, depth + 1, near,
+                            q + hex_directions[i][0],
+                            r + hex_directions[i][1]);
+        }
     }
+
+    sc->path[cell / 64] &= ~bit;
 }
 
 /*
@@ -364,90 +3483,407 @@ find_words_trie(honeycomb *hc, trie_node *node, word_store* store,
  * words starting with the character in the trie.
  * Incase a match is found in the trie, find all words
  * in the trie matching prefix with adjoining characters of
- * the original character in the honeycomb. */
+ * the original character in the honeycomb.
+ * Each word found is added to the store once, as its word id. */
 void
-find_words(honeycomb *hc, trie_node *root, word_store* store)
+find_words(const honeycomb *hc, const dict *d, match_set *matches,
+           word_store* store)
 {
-    char *word = (char *) malloc(WORD_SIZE);
+    search sc;
+    sc.hc = hc;
+    sc.d = d;
+    sc.matches = matches;
+    sc.store = store;
+    sc.letters = 0;
+    sc.cells = hc->size;
+    sc.path = NULL;
+
+    /* forget the words reported by the previous search */
+    if (++matches->generation == 0) {
+        memset(matches->seen, 0, matches->size * sizeof(uint32_t));
+        matches->generation = 1;
+    }
+
+    int i;
+    for (i = 0; i < hc->size; i++) {
+        sc.letters |= 1u << CHAR_TO_INDEX(hc->cells[i]);
+    }
 
-    int i, j;
-    for (i = 0; i < hc->number_columns; i++) {
-        for (j = 0; j < strlen(hc->columns[i]); j++) {
-            word[0] = '\0';
-            find_words_trie(hc, root, store, word, i, j);
+    bool small = hc->size <= SMALL_HONEYCOMB;
+    if (!small) {
+        sc.path = (uint64_t *) calloc((hc->size + 63) / 64,
+                                      sizeof(uint64_t));
+        if (sc.path == NULL) {
+            printf("Error: Failed to allocate memory for Search.\n");
+            exit(1);
         }
     }
 
-    free(word);
+    int radius = hc->radius, q, r;
+    for (q = -radius; q <= radius; q++) {
+        int top = q < 0 ? -radius - q : -radius;
+        int bottom = q > 0 ? radius - q : radius;
+        for (r = top; r <= bottom; r++) {
+            int cell = hex_cell(hc, q, r);
+            if (small) {
+                find_words_small(&sc, TRIE_ROOT, 0, 0, cell, q, r, 0);
+            } else {
+                find_words_trie(&sc, TRIE_ROOT, 0, 0, cell, q, r);
+            }
+        }
+    }
+    free(sc.path);
 }
 
 /*
- * comparator
+ * fill_layer
  *
- * Compares two words for sort order when sorting found words.
+ * Store the letters of one line of a honeycomb file, from line up
+ * to end, as the next layer of the honeycomb and advance *layer.
+ * Layer 0 is the center cell; layer k > 0 is the ring of 6 * k
+ * cells around it, from the cell above the center clockwise. Lines
+ * without letters are skipped.
  */
-int
-comparator(const void *word1, const void *word2)
+void
+fill_layer(honeycomb *hc, const char *line, const char *end, int *layer)
 {
-    return strcmp(*(char **) word1, *(char **) word2);
+    const unsigned char *table = letter_table();
+    int k = *layer;
+
+    /* ring k starts at the top, (0, -k), and turns clockwise, which
+       is hex_directions[2] onwards, every k cells */
+    int q = 0, r = -k, expected = k ? 6 * k : 1;
+    int count = 0;
+    const char *c;
+    for (c = line; c < end; c++) {
+        if (*c == ' ' || *c == '\t' || *c == '\r' || *c == '\n') continue;
+
+        unsigned char letter = table[(unsigned char) *c];
+        if (letter == 0) {
+            printf("Error: Invalid letter '%c' in honeycomb.\n", *c);
+            exit(1);
+        }
+        if (k > hc->radius) {
+            printf("Error: Honeycomb has more than %d layers.\n",
+                   hc->radius + 1);
+            exit(1);
+        }
+        if (count == expected) break;
+
+        hc->cells[hex_cell(hc, q, r)] = letter;
+        if (k > 0) {
+            const int *step = hex_directions[(2 + count / k) % HEX_NEIGHBORS];
+            q += step[0];
+            r += step[1];
+        }
+        count++;
+    }
+
+    if (count == 0 && c == end) return;
+    if (c < end || count != expected) {
+        printf("Error: Wrong number of letters in honeycomb layer"
+               " %d (expected %d).\n", k, expected);
+        exit(1);
+    }
+    (*layer)++;
 }
 
-int
-main(int argc, char *argv[])
+/*
+ * read_honeycomb
+ *
+ * Create a honeycomb from letters in the file: the number of
+ * layers, then one line per layer (see fill_layer). Spaces and
+ * blank lines are skipped and lower case letters taken as upper
+ * case. The file is read a line at a time, each letter going
+ * straight to its cell, so besides the honeycomb only the longest
+ * line is held in memory.
+ */
+honeycomb *
+read_honeycomb(FILE *fp)
 {
-    if (argc != 3) {
-        printf("Error: Insufficient arguments.\nNeed two files"
-               " (honeycomb.txt and dictionary.txt) as input.\n");
+    char *line = NULL;
+    size_t capacity = 0;
+    ssize_t length = getline(&line, &capacity, fp);
+
+    char *at = line;
+    long layers = length > 0 ? strtol(line, &at, 10) : 0;
+    if (at == line || layers < 1 || layers > MAX_LAYERS) {
+        printf("Error: Honeycomb needs between 1 and %d layers.\n",
+               MAX_LAYERS);
         exit(1);
     }
 
-    FILE *honeycomb_fp = fopen(argv[1], "r");
-    if (honeycomb_fp == NULL) {
-        printf("Error: honeycomb.txt file missing.\n");
+    honeycomb *hc = create_honeycomb(layers);
+
+    /* the first line may go on after the number */
+    int layer = 0;
+    fill_layer(hc, at, line + length, &layer);
+    while ((length = getline(&line, &capacity, fp)) > 0) {
+        fill_layer(hc, line, line + length, &layer);
+    }
+    free(line);
+
+    if (ferror(fp)) {
+        printf("Error: Failed to read honeycomb.\n");
+        exit(1);
+    }
+    if (layer != layers) {
+        printf("Error: Honeycomb has %d of its %ld layers.\n",
+               layer, layers);
         exit(1);
     }
 
-    FILE *dictionary_fp = fopen(argv[2], "r");
-    if (dictionary_fp == NULL) {
-        printf("Error: dictionary.txt file missing.\n");
+    return hc;
+}
+
+/*
+ * load_honeycomb
+ *
+ * Create a honeycomb from the letters in the file called name,
+ * which is the first honeycomb on the command line if first is set.
+ */
+honeycomb *
+load_honeycomb(const char *name, bool first)
+{
+    FILE *honeycomb_fp = fopen(name, "r");
+    if (honeycomb_fp == NULL) {
+        if (first) {
+            printf("Error: honeycomb.txt file missing.\n");
+        } else {
+            printf("Error: %s file missing.\n", name);
+        }
         exit(1);
     }
 
-    /* Create a honeycomb from letters in the file. */
-    int layers;
-    fscanf(honeycomb_fp, "%d", &layers);
-    honeycomb *hc = create_honeycomb(layers);
-    fill_honeycomb(hc, honeycomb_fp, layers);
+    honeycomb *hc = read_honeycomb(honeycomb_fp);
     fclose(honeycomb_fp);
 
-    /* Create a Trie for all the words in the dictionary. */
-    trie_node *root = get_trienode();
-    fill_trie(root, dictionary_fp);
-    fclose(dictionary_fp);
+    return hc;
+}
 
+/*
+ * print_words
+ *
+ * Find the dictionary words in the honeycomb and print them
+ * in sorted order.
+ */
+void
+print_words(const honeycomb *hc, const dict *d, match_set *matches)
+{
     /* Create a Word Store to store all the words found. */
     word_store* store = create_store();
-    find_words(hc, root, store);
+    find_words(hc, d, matches, store);
 
     if (store->size == 0) {
         printf("No words found.\n");
+    } else if (d->ordered) {
+        /* word ids sort the same way as the words themselves */
+        qsort(store->words, store->size, sizeof(uint32_t), id_comparator);
+
+        int i;
+        for (i = 0; i < store->size; i++) {
+            printf("%s\n", word_text(d->words, store->words[i]));
+        }
     } else {
-        qsort(store->words, store->size, sizeof(char *), comparator);
+        char **found = (char **) malloc(store->size * sizeof(char *));
+        if (found == NULL) {
+            printf("Error: Failed to allocate memory for Word Store.\n");
+            exit(1);
+        }
 
         int i;
-        printf("%s\n", store->words[0]);
-        for (i = 1; i < store->size; i++) {
-            /* avoid duplicates */
-            if (strcmp(store->words[i], store->words[i-1]) != 0) {
-                printf("%s\n", store->words[i]);
-            }
+        for (i = 0; i < store->size; i++) {
+            found[i] = (char *) word_text(d->words, store->words[i]);
+        }
+        qsort(found, store->size, sizeof(char *), comparator);
+
+        for (i = 0; i < store->size; i++) {
+            printf("%s\n", found[i]);
         }
+        free(found);
     }
 
-    /* Free the honeycomb, trie and word store after done */
-    delete_honeycomb(hc);
-    delete_trie(root);
     delete_store(store);
+}
+
+/*
+ * usage
+ *
+ * Print command line usage and exit.
+ */
+void
+usage(void)
+{
+    printf("Usage: honeycomb_trie [-f] [-j threads] [-m] [-p]"
+           " [-t array|sparse|double|louds|radix] [-v]"
+           " honeycomb.txt dictionary.txt [honeycomb.txt ...]\n"
+           "       honeycomb_trie [-j threads] [-m] [-p]"
+           " [-t array|sparse|double|louds|radix]"
+           " -c dictionary.img dictionary.txt\n"
+           "  -c  compile the dictionary into an image and exit; an image\n"
+           "      given as the dictionary is used as it was compiled, so\n"
+           "      -f, -m, -p and -t cannot be given with it\n"
+           "  -f  load only the words the honeycombs have the letters for\n"
+           "  -j  threads to build the trie with (default: one per CPU)\n"
+           "  -m  build a minimal DAWG (array representation only)\n"
+           "  -p  store subtree summaries to prune the search\n"
+           "  -t  trie representation to search (default: array)\n"
+           "  -v  check every section of a dictionary image against its\n"
+           "      checksum before searching it\n");
+    exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+    trie_kind kind = TRIE_ARRAY;
+    bool kind_given = false;
+    bool minimize = false;
+    bool summarize = false;
+    bool filter = false;
+    bool verify = false;
+    char *image_name = NULL;
+    int threads = sysconf(_SC_NPROCESSORS_ONLN);
+    int opt;
+
+    while ((opt = getopt(argc, argv, "c:fj:mpt:v")) != -1) {
+        switch (opt) {
+        case 'j':
+            threads = atoi(optarg);
+            if (threads < 1) {
+                printf("Error: Need at least one thread.\n");
+                usage();
+            }
+            break;
+        case 'c':
+            image_name = optarg;
+            break;
+        case 'f':
+            filter = true;
+            break;
+        case 'm':
+            minimize = true;
+            break;
+        case 'p':
+            summarize = true;
+            break;
+        case 't':
+            kind_given = true;
+            if (strcmp(optarg, "array") == 0) {
+                kind = TRIE_ARRAY;
+            } else if (strcmp(optarg, "sparse") == 0) {
+                kind = TRIE_SPARSE;
+            } else if (strcmp(optarg, "double") == 0) {
+                kind = TRIE_DOUBLE_ARRAY;
+            } else if (strcmp(optarg, "louds") == 0) {
+                kind = TRIE_LOUDS;
+            } else if (strcmp(optarg, "radix") == 0) {
+                kind = TRIE_RADIX;
+            } else {
+                printf("Error: Unknown trie representation '%s'.\n", optarg);
+                usage();
+            }
+            break;
+        case 'v':
+            verify = true;
+            break;
+        default:
+            usage();
+        }
+    }
+
+    if (minimize && kind != TRIE_ARRAY) {
+        printf("Error: A DAWG can only be searched as an array trie.\n");
+        usage();
+    }
+
+    argc -= optind;
+    argv += optind - 1;
+
+    if (image_name != NULL) {
+        if (argc != 1 || filter || verify) usage();
+
+        FILE *dictionary_fp = fopen(argv[1], "r");
+        if (dictionary_fp == NULL) {
+            printf("Error: dictionary.txt file missing.\n");
+            exit(1);
+        }
+        dict *d = create_dict(dictionary_fp, kind, minimize, summarize,
+                              NULL, threads);
+        fclose(dictionary_fp);
+
+        save_dict(d, image_name);
+
+        delete_dict(d);
+        return 0;
+    }
+
+    if (argc < 2) {
+        printf("Error: Insufficient arguments.\nNeed two files"
+               " (honeycomb.txt and dictionary.txt) as input.\n");
+        usage();
+    }
+
+    /* With -f the letters of every honeycomb must be known before
+       the dictionary is loaded, so all of them are read first.
+       Otherwise each is read only when its turn comes, so just one
+       is in memory at a time. */
+    int count = argc - 1;
+    honeycomb **hcs = (honeycomb **) calloc(count, sizeof(honeycomb *));
+    if (hcs == NULL) {
+        printf("Error: Failed to allocate memory for Honeycomb.\n");
+        exit(1);
+    }
+
+    uint32_t inventory[ALPHABET_SIZE] = {0};
+    int i;
+    for (i = 0; i < (filter ? count : 1); i++) {
+        hcs[i] = load_honeycomb(argv[i == 0 ? 1 : i + 2], i == 0);
+        count_letters(hcs[i], inventory);
+    }
+
+    FILE *dictionary_fp = fopen(argv[2], "r");
+    if (dictionary_fp == NULL) {
+        printf("Error: dictionary.txt file missing.\n");
+        exit(1);
+    }
+
+    /* Create a Trie for all the words in the dictionary, or map
+       the one compiled into an image. */
+    dict *d;
+    if (is_image(dictionary_fp)) {
+        if (filter || minimize || summarize || kind_given) {
+            printf("Error: -f, -m, -p and -t do not apply to a"
+                   " dictionary image.\n");
+            usage();
+        }
+        d = map_dict(dictionary_fp, verify);
+    } else {
+        if (verify) {
+            printf("Error: -v only applies to a dictionary image.\n");
+            usage();
+        }
+        d = create_dict(dictionary_fp, kind, minimize, summarize,
+                        filter ? inventory : NULL, threads);
+    }
+    fclose(dictionary_fp);
+
+    /* The dictionary is never modified by a search, so it can
+       answer every honeycomb as it is. */
+    match_set *matches = create_match_set(d);
+    for (i = 0; i < count; i++) {
+        if (hcs[i] == NULL) hcs[i] = load_honeycomb(argv[i + 2], false);
+
+        if (i > 0) printf("\n");
+        print_words(hcs[i], d, matches);
+        delete_honeycomb(hcs[i]);
+        hcs[i] = NULL;
+    }
+    free(hcs);
+
+    /* Free the trie and match set after done */
+    delete_match_set(matches);
+    delete_dict(d);
 
     return 0;
 }